@@ -312,6 +312,13 @@ void TileMap3DEditor::_collection_selected(int p_index) {
     }
 }
 
+void TileMap3DEditor::_bake_meshes_pressed() {
+    if (!tilemap) {
+        return;
+    }
+    tilemap->make_baked_meshes();
+}
+
 void TileMap3DEditor::set_3d_controls_visibility(bool p_visible) {
     set_process(p_visible);
     RS::get_singleton()->instance_set_visible(grid_instance, p_visible);
@@ -578,6 +585,12 @@ TileMap3DEditor::TileMap3DEditor(EditorNode *p_editor) {
     tile_list->set_h_size_flags(SIZE_EXPAND_FILL);
     tile_list->set_v_size_flags(SIZE_EXPAND_FILL);
     bottom_container->add_child(tile_list);
+
+    bake_meshes_button = memnew(Button);
+    bake_meshes_button->set_text(TTR("Bake Meshes"));
+    bake_meshes_button->set_tooltip(TTR("Merge the tiles of each octant into static meshes."));
+    bake_meshes_button->connect("pressed", callable_mp(this, &TileMap3DEditor::_bake_meshes_pressed));
+    add_child(bake_meshes_button);
 }
 
 TileMap3DEditor::~TileMap3DEditor() {
@@ -62,6 +62,8 @@ private:
     Button *display_thumbnails_button;
     Button *display_list_button;
 
+    Button *bake_meshes_button;
+
     ItemList *layer_list;
     OptionButton *collection_options;
     ItemList *tile_list;
@@ -83,6 +85,7 @@ private:
     void _fit_tools_buttons();
     void _update_tileset_ui();
     void _collection_selected(int p_index);
+    void _bake_meshes_pressed();
 
 protected:
 	void _notification(int p_what);
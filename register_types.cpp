@@ -43,6 +43,7 @@ void register_tilemap3d_types() {
 	GDREGISTER_CLASS(TileSet3DCollection);
 	GDREGISTER_VIRTUAL_CLASS(TileData3D);
 	GDREGISTER_CLASS(TileData3DMesh);
+	TileMap3D::init_thread_pool();
 #ifdef TOOLS_ENABLED
 	EditorPlugins::add_by_type<Tiles3DEditorPlugin>();
 #endif
@@ -50,4 +51,7 @@ void register_tilemap3d_types() {
 }
 
 void unregister_tilemap3d_types() {
+#ifndef _3D_DISABLED
+	TileMap3D::finish_thread_pool();
+#endif
 }
@@ -28,8 +28,215 @@
 /* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
 /*************************************************************************/
 
+#include "core/math/convex_hull.h"
 #include "core/object/message_queue.h"
+#include "core/os/os.h"
+#include "scene/3d/camera_3d.h"
+#include "scene/resources/concave_polygon_shape_3d.h"
+#include "scene/resources/convex_polygon_shape_3d.h"
+#include "scene/resources/mesh.h"
+#include "servers/navigation_server_3d.h"
+#include "servers/physics_server_3d.h"
 #include "tile_map_3d.h"
+#include "tile_map_3d_simd.h"
+
+ThreadWorkPool *TileMap3D::thread_pool = nullptr;
+ThreadWorkPool *TileMap3D::job_pool = nullptr;
+
+int TileMap3D::CellChunk::next_used(int p_from) const {
+	if (p_from >= CELL_COUNT) {
+		return -1;
+	}
+	int w = p_from >> 6;
+	uint64_t bits = used[w] & (~uint64_t(0) << (p_from & 63));
+	while (true) {
+		if (bits) {
+			int b = 0;
+			while (!(bits & (uint64_t(1) << b))) {
+				b++;
+			}
+			return (w << 6) + b;
+		}
+		w++;
+		if (w == WORD_COUNT) {
+			return -1;
+		}
+		bits = used[w];
+	}
+}
+
+TileMap3D::CellChunk *TileMap3D::CellStorage::_get_chunk(const Vector3i &p_cell) const {
+	CellChunk *const *C = chunk_map.getptr(get_chunk_key(p_cell));
+	return C ? *C : nullptr;
+}
+
+const TileMap3D::CellChunk *TileMap3D::CellStorage::get_chunk(const Vector3i &p_cell) const {
+	return _get_chunk(p_cell);
+}
+
+int TileMap3D::CellStorage::find(const Vector3i &p_cell, const CellChunk *&r_chunk) const {
+	if (!r_chunk || r_chunk->key != get_chunk_key(p_cell)) {
+		r_chunk = _get_chunk(p_cell);
+		if (!r_chunk) {
+			return -1;
+		}
+	}
+	int idx = CellChunk::get_cell_index(p_cell);
+	return r_chunk->has(idx) ? idx : -1;
+}
+
+bool TileMap3D::CellStorage::get(const Vector3i &p_cell, MapTile &r_tile) const {
+	const CellChunk *chunk = nullptr;
+	int idx = find(p_cell, chunk);
+	if (idx < 0) {
+		return false;
+	}
+	r_tile.tile = chunk->tiles[idx];
+	r_tile.rot_idx = chunk->rotations[idx];
+	return true;
+}
+
+void TileMap3D::CellStorage::set(const Vector3i &p_cell, const MapTile &p_tile) {
+	uint64_t key = get_chunk_key(p_cell);
+	CellChunk **C = chunk_map.getptr(key);
+	CellChunk *chunk;
+	if (C) {
+		chunk = *C;
+	} else {
+		chunk = memnew(CellChunk);
+		chunk->key = key;
+		chunk->origin = Vector3i(p_cell.x & ~CellChunk::MASK, p_cell.y & ~CellChunk::MASK, p_cell.z & ~CellChunk::MASK);
+		chunk->list_index = chunks.size();
+		chunks.push_back(chunk);
+		chunk_map[key] = chunk;
+	}
+
+	int idx = CellChunk::get_cell_index(p_cell);
+	uint64_t bit = uint64_t(1) << (idx & 63);
+	if (!(chunk->used[idx >> 6] & bit)) {
+		chunk->used[idx >> 6] |= bit;
+		chunk->count++;
+		cell_count++;
+	} else if (chunk->rotations[idx] == MapTile::NON_ORTHOGONAL_ROT) {
+		custom_rotations.erase(p_cell);
+	}
+	chunk->tiles[idx] = p_tile.tile;
+	chunk->rotations[idx] = p_tile.rot_idx;
+	chunk->flags[idx] = 0;
+}
+
+uint8_t TileMap3D::CellStorage::get_flags(const Vector3i &p_cell) const {
+	const CellChunk *chunk = _get_chunk(p_cell);
+	int idx = CellChunk::get_cell_index(p_cell);
+	if (!chunk || !chunk->has(idx)) {
+		return 0;
+	}
+	return chunk->flags[idx];
+}
+
+void TileMap3D::CellStorage::set_flags(const Vector3i &p_cell, uint8_t p_flags) {
+	CellChunk *chunk = _get_chunk(p_cell);
+	int idx = CellChunk::get_cell_index(p_cell);
+	ERR_FAIL_COND(!chunk || !chunk->has(idx));
+	chunk->flags[idx] = p_flags;
+}
+
+bool TileMap3D::CellStorage::set_rotation_index(const Vector3i &p_cell, int p_rot_idx) {
+	CellChunk *chunk = _get_chunk(p_cell);
+	int idx = CellChunk::get_cell_index(p_cell);
+	if (!chunk || !chunk->has(idx)) {
+		return false;
+	}
+	if (chunk->rotations[idx] == MapTile::NON_ORTHOGONAL_ROT) {
+		custom_rotations.erase(p_cell);
+	}
+	chunk->rotations[idx] = p_rot_idx;
+	return true;
+}
+
+bool TileMap3D::CellStorage::set_rotation(const Vector3i &p_cell, const Basis &p_rotation) {
+	CellChunk *chunk = _get_chunk(p_cell);
+	int idx = CellChunk::get_cell_index(p_cell);
+	if (!chunk || !chunk->has(idx)) {
+		return false;
+	}
+
+	// Keep the side table for rotations that can't be expressed as an index.
+	// Rotations built from angles are only close to the orthogonal ones, the
+	// index stores the exact basis.
+	int ortho = p_rotation.get_orthogonal_index();
+	if (_get_orthogonal_basis(ortho).is_equal_approx(p_rotation)) {
+		return set_rotation_index(p_cell, ortho);
+	}
+	chunk->rotations[idx] = MapTile::NON_ORTHOGONAL_ROT;
+	custom_rotations[p_cell] = p_rotation;
+	return true;
+}
+
+Basis TileMap3D::CellStorage::get_rotation(const Vector3i &p_cell, int p_rot_idx) const {
+	if (p_rot_idx != MapTile::NON_ORTHOGONAL_ROT) {
+		return _get_orthogonal_basis(p_rot_idx);
+	}
+	const Map<Vector3i, Basis>::Element *E = custom_rotations.find(p_cell);
+	ERR_FAIL_NULL_V(E, Basis());
+	return E->get();
+}
+
+bool TileMap3D::CellStorage::erase(const Vector3i &p_cell) {
+	uint64_t key = get_chunk_key(p_cell);
+	CellChunk **C = chunk_map.getptr(key);
+	if (!C) {
+		return false;
+	}
+	CellChunk *chunk = *C;
+	int idx = CellChunk::get_cell_index(p_cell);
+	uint64_t bit = uint64_t(1) << (idx & 63);
+	if (!(chunk->used[idx >> 6] & bit)) {
+		return false;
+	}
+
+	if (chunk->rotations[idx] == MapTile::NON_ORTHOGONAL_ROT) {
+		custom_rotations.erase(p_cell);
+	}
+	chunk->used[idx >> 6] &= ~bit;
+	chunk->count--;
+	cell_count--;
+
+	if (chunk->count == 0) {
+		// Swap with the last chunk to keep the list packed.
+		uint32_t li = chunk->list_index;
+		CellChunk *last = chunks[chunks.size() - 1];
+		chunks[li] = last;
+		last->list_index = li;
+		chunks.resize(chunks.size() - 1);
+		chunk_map.erase(key);
+		memdelete(chunk);
+	}
+	return true;
+}
+
+void TileMap3D::CellStorage::clear() {
+	for (uint32_t i = 0; i < chunks.size(); i++) {
+		memdelete(chunks[i]);
+	}
+	chunks.clear();
+	chunk_map.clear();
+	custom_rotations.clear();
+	cell_count = 0;
+}
+
+const Basis &TileMap3D::_get_orthogonal_basis(int p_index) {
+	struct OrthogonalBases {
+		Basis bases[MapTile::ORTHOGONAL_ROT_COUNT];
+		OrthogonalBases() {
+			for (int i = 0; i < MapTile::ORTHOGONAL_ROT_COUNT; i++) {
+				bases[i].set_orthogonal_index(i);
+			}
+		}
+	};
+	static const OrthogonalBases table;
+	return table.bases[p_index];
+}
 
 void TileMap3D::_queue_octants_dirty() {
 	if (awaiting_update) {
@@ -42,39 +249,572 @@ void TileMap3D::_queue_octants_dirty() {
 
 void TileMap3D::_recreate_octant_data() {
 	_clear_octants();
+	path_graph.clear();
 	for (int i = 0; i < layers.size(); i++) {
-		const Map<MapCell, MapTile> &tile_map = layers[i].tile_map;
-		for (const KeyValue<MapCell, MapTile> &E : tile_map) {
-			OctantKey ok = _cell_to_octant(E.key);
-			_insert_octant_cell(ok, E.key);
+		const CellStorage &storage = *layers[i].cells;
+		for (int j = 0; j < storage.get_chunk_count(); j++) {
+			const CellChunk *chunk = storage.get_chunk_by_index(j);
+			for (int k = chunk->next_used(0); k >= 0; k = chunk->next_used(k + 1)) {
+				MapCell cell(chunk->get_cell(k), i);
+				_insert_octant_cell(_cell_to_octant(cell), cell);
+			}
 		}
 	}
 	_queue_octants_dirty();
+	// Light cells store their layer index as well.
+	_recreate_light_cells();
 }
 
 void TileMap3D::_update_octants_callback() {
-	ERR_FAIL_NULL(tile_set);
 	if (!awaiting_update) {
 		return;
 	}
+	if (tile_set.is_null()) {
+		// Octants stay queued until a tile set is assigned.
+		awaiting_update = false;
+		_update_internal_processing();
+		return;
+	}
+
+	uint64_t begin = OS::get_singleton()->get_ticks_usec();
+	if (update_budget_usec > 0) {
+		_sort_dirty_octants();
+	}
+
+	uint32_t from = 0;
+	while (from < dirty_octants.size()) {
+		uint32_t to = dirty_octants.size();
+		if (update_budget_usec > 0) {
+			to = MIN(from + OCTANT_UPDATE_BATCH, to);
+		}
+		_update_octant_range(from, to);
+		from = to;
+
+		if (update_budget_usec > 0 && OS::get_singleton()->get_ticks_usec() - begin >= (uint64_t)update_budget_usec) {
+			break;
+		}
+	}
+
+	if (from < dirty_octants.size()) {
+		// Out of time, carry the rest over to the next frame.
+		LocalVector<OctantKey> remaining;
+		remaining.resize(dirty_octants.size() - from);
+		for (uint32_t i = 0; i < remaining.size(); i++) {
+			remaining[i] = dirty_octants[from + i];
+		}
+		dirty_octants = remaining;
+		_update_internal_processing();
+		return;
+	}
+
+	dirty_octants.clear();
+	awaiting_update = false;
+	_update_internal_processing();
+
+	_trim_multimesh_pool(rid_pool_idle_size);
+}
+
+void TileMap3D::_update_internal_processing() {
+	bool updating = awaiting_update && !dirty_octants.is_empty();
+	set_process_internal(updating || !queued_jobs.is_empty() || !running_jobs.is_empty() || !light_cells.is_empty());
+}
+
+void TileMap3D::_queue_octant_job(OctantJob *p_job) {
+	queued_jobs.push_back(p_job);
+	_update_internal_processing();
+}
+
+void TileMap3D::_octant_job_thread(uint32_t p_index, OctantJob **p_jobs) {
+	p_jobs[p_index]->process();
+	finished_jobs.increment();
+}
+
+void TileMap3D::_process_octant_jobs() {
+	if (!running_jobs.is_empty()) {
+		if (finished_jobs.get() < running_jobs.size()) {
+			return;
+		}
+		_finish_running_jobs();
+	}
+
+	if (!queued_jobs.is_empty() && !job_pool->is_working()) {
+		// Start the next batch in the background.
+		running_jobs = queued_jobs;
+		queued_jobs.clear();
+		finished_jobs.set(0);
+		job_pool->begin_work(running_jobs.size(), this, &TileMap3D::_octant_job_thread, running_jobs.ptr());
+	}
+	_update_internal_processing();
+}
+
+void TileMap3D::_finish_running_jobs() {
+	if (running_jobs.is_empty()) {
+		return;
+	}
+	job_pool->end_work();
+	_apply_octant_jobs(running_jobs);
+}
+
+void TileMap3D::_flush_octant_jobs() {
+	// Blocks until every job is done and applied.
+	_finish_running_jobs();
+	if (!queued_jobs.is_empty()) {
+		thread_pool->do_work(queued_jobs.size(), this, &TileMap3D::_octant_job_thread, queued_jobs.ptr());
+		_apply_octant_jobs(queued_jobs);
+	}
+	_update_internal_processing();
+}
+
+void TileMap3D::_apply_octant_jobs(LocalVector<OctantJob *> &p_jobs) {
+	for (uint32_t i = 0; i < p_jobs.size(); i++) {
+		OctantJob *job = p_jobs[i];
+		Map<OctantKey, Octant *>::Element *O = octant_map.find(job->key);
+		if (O && O->get()->version == job->version) {
+			job->apply(this, O->get());
+		}
+		memdelete(job);
+	}
+	p_jobs.clear();
+}
+
+void TileMap3D::_octant_queue_bake(const OctantKey &p_key, Octant *p_oct) {
+	if (p_oct->bake_version == p_oct->version) {
+		return;
+	}
+	p_oct->bake_version = p_oct->version;
+
+	OctantBakeJob *job = memnew(OctantBakeJob);
+	job->key = p_key;
+	job->version = p_oct->version;
+
+	// Everything the job needs is gathered here, the worker only reads it.
+	const CellChunk *chunk = nullptr;
+	int chunk_layer = -1;
+	for (Set<MapCell>::Element *E = p_oct->cells.front(); E; E = E->next()) {
+		const MapCell &cell = E->get();
+		if (cell.layer != chunk_layer) {
+			chunk = nullptr;
+			chunk_layer = cell.layer;
+		}
+		int ci = layers[cell.layer].cells->find(cell, chunk);
+		ERR_CONTINUE(ci < 0);
+
+		MapTile mt;
+		mt.tile = chunk->tiles[ci];
+		mt.rot_idx = chunk->rotations[ci];
+		Map<MapTile::Tile, TileCache *>::Element *C = tile_cache.find(_get_tile_cache_key(mt.tile));
+		if (!C || C->get()->data.is_null() || !C->get()->mesh.is_valid()) {
+			continue;
+		}
+		TileCache *cache = C->get();
+		if (_is_culling_hidden_cells() && _is_cell_hidden(cell)) {
+			continue;
+		}
+		_cache_tile_surfaces(cache);
+
+		Transform3D transform = _get_cell_transform(cell, mt, *cache);
+		Ref<Material> material_override = cache->data->get_material_override();
+		for (int i = 0; i < cache->surface_arrays.size(); i++) {
+			Ref<Material> material = material_override.is_valid() ? material_override : cache->surface_materials[i];
+
+			// Cells are sorted by layer, so only the surfaces of the current
+			// layer have to be searched.
+			OctantBakeJob::Surface *surface = nullptr;
+			for (int j = job->surfaces.size() - 1; j >= 0 && job->surfaces[j].layer == cell.layer; j--) {
+				if (job->surfaces[j].material == material) {
+					surface = &job->surfaces[j];
+					break;
+				}
+			}
+			if (!surface) {
+				job->surfaces.push_back(OctantBakeJob::Surface());
+				surface = &job->surfaces[job->surfaces.size() - 1];
+				surface->layer = cell.layer;
+				surface->material = material;
+			}
+			surface->arrays.push_back(cache->surface_arrays[i]);
+			surface->transforms.push_back(transform);
+		}
+	}
+
+	_queue_octant_job(job);
+}
+
+void TileMap3D::_octant_clear_baked(Octant *p_oct) {
+	if (p_oct->baked_meshes.is_empty()) {
+		return;
+	}
+	for (uint32_t i = 0; i < p_oct->baked_meshes.size(); i++) {
+		RS::get_singleton()->free(p_oct->baked_meshes[i].instance);
+	}
+	p_oct->baked_meshes.clear();
+
+	if (is_inside_tree()) {
+		for (int i = 0; i < p_oct->multimesh_instances.size(); i++) {
+			const Octant::MultimeshInstance &mmi = p_oct->multimesh_instances[i];
+			_multimesh_set_visible(mmi, _is_layer_visible(mmi.tile.layer));
+		}
+	}
+}
+
+void TileMap3D::_cache_tile_surfaces(TileCache *p_cache) {
+	if (!p_cache->surface_arrays.is_empty()) {
+		return;
+	}
+	Ref<Mesh> mesh = p_cache->data->get_mesh();
+	for (int i = 0; i < mesh->get_surface_count(); i++) {
+		if (mesh->surface_get_primitive_type(i) != Mesh::PRIMITIVE_TRIANGLES) {
+			continue;
+		}
+		p_cache->surface_arrays.push_back(mesh->surface_get_arrays(i));
+		p_cache->surface_materials.push_back(mesh->surface_get_material(i));
+	}
+}
+
+// Concatenates triangle surfaces after transforming them. Only the channels
+// present in every part are kept.
+static Array _merge_surface_arrays(const LocalVector<Array> &p_arrays, const LocalVector<Transform3D> &p_transforms) {
+	const int channels[] = { Mesh::ARRAY_NORMAL, Mesh::ARRAY_TANGENT, Mesh::ARRAY_COLOR, Mesh::ARRAY_TEX_UV, Mesh::ARRAY_TEX_UV2 };
+	bool has[Mesh::ARRAY_MAX] = {};
+	for (int c : channels) {
+		has[c] = true;
+	}
+
+	int vertex_count = 0;
+	int index_count = 0;
+	for (uint32_t i = 0; i < p_arrays.size(); i++) {
+		const Array &a = p_arrays[i];
+		int vc = PackedVector3Array(a[Mesh::ARRAY_VERTEX]).size();
+		int ic = PackedInt32Array(a[Mesh::ARRAY_INDEX]).size();
+		vertex_count += vc;
+		index_count += ic > 0 ? ic : vc;
+		for (int c : channels) {
+			has[c] = has[c] && a[c].get_type() != Variant::NIL;
+		}
+	}
+
+	PackedVector3Array vertices;
+	PackedVector3Array normals;
+	PackedFloat32Array tangents;
+	PackedColorArray colors;
+	PackedVector2Array uvs;
+	PackedVector2Array uv2s;
+	PackedInt32Array indices;
+	vertices.resize(vertex_count);
+	indices.resize(index_count);
+	normals.resize(has[Mesh::ARRAY_NORMAL] ? vertex_count : 0);
+	tangents.resize(has[Mesh::ARRAY_TANGENT] ? vertex_count * 4 : 0);
+	colors.resize(has[Mesh::ARRAY_COLOR] ? vertex_count : 0);
+	uvs.resize(has[Mesh::ARRAY_TEX_UV] ? vertex_count : 0);
+	uv2s.resize(has[Mesh::ARRAY_TEX_UV2] ? vertex_count : 0);
+
+	int vofs = 0;
+	int iofs = 0;
+	for (uint32_t i = 0; i < p_arrays.size(); i++) {
+		const Array &a = p_arrays[i];
+		const Transform3D &xform = p_transforms[i];
+		Basis normal_basis = xform.basis.inverse().transposed();
+		// Mirroring transforms flip the winding order.
+		bool flip = xform.basis.determinant() < 0.0;
+
+		PackedVector3Array src_vertices = a[Mesh::ARRAY_VERTEX];
+		int vc = src_vertices.size();
+		for (int j = 0; j < vc; j++) {
+			vertices.write[vofs + j] = xform.xform(src_vertices[j]);
+		}
+		if (has[Mesh::ARRAY_NORMAL]) {
+			PackedVector3Array src = a[Mesh::ARRAY_NORMAL];
+			for (int j = 0; j < vc; j++) {
+				normals.write[vofs + j] = normal_basis.xform(src[j]).normalized();
+			}
+		}
+		if (has[Mesh::ARRAY_TANGENT]) {
+			PackedFloat32Array src = a[Mesh::ARRAY_TANGENT];
+			for (int j = 0; j < vc; j++) {
+				Vector3 t = xform.basis.xform(Vector3(src[j * 4], src[j * 4 + 1], src[j * 4 + 2])).normalized();
+				tangents.write[(vofs + j) * 4] = t.x;
+				tangents.write[(vofs + j) * 4 + 1] = t.y;
+				tangents.write[(vofs + j) * 4 + 2] = t.z;
+				tangents.write[(vofs + j) * 4 + 3] = flip ? -src[j * 4 + 3] : src[j * 4 + 3];
+			}
+		}
+		if (has[Mesh::ARRAY_COLOR]) {
+			PackedColorArray src = a[Mesh::ARRAY_COLOR];
+			memcpy(colors.ptrw() + vofs, src.ptr(), vc * sizeof(Color));
+		}
+		if (has[Mesh::ARRAY_TEX_UV]) {
+			PackedVector2Array src = a[Mesh::ARRAY_TEX_UV];
+			memcpy(uvs.ptrw() + vofs, src.ptr(), vc * sizeof(Vector2));
+		}
+		if (has[Mesh::ARRAY_TEX_UV2]) {
+			PackedVector2Array src = a[Mesh::ARRAY_TEX_UV2];
+			memcpy(uv2s.ptrw() + vofs, src.ptr(), vc * sizeof(Vector2));
+		}
+
+		PackedInt32Array src_indices = a[Mesh::ARRAY_INDEX];
+		int ic = src_indices.size() > 0 ? src_indices.size() : vc;
+		int32_t *w = indices.ptrw() + iofs;
+		for (int j = 0; j < ic; j++) {
+			w[j] = vofs + (src_indices.size() > 0 ? src_indices[j] : j);
+		}
+		if (flip) {
+			for (int j = 0; j + 2 < ic; j += 3) {
+				SWAP(w[j + 1], w[j + 2]);
+			}
+		}
+
+		vofs += vc;
+		iofs += ic;
+	}
+
+	Array result;
+	result.resize(Mesh::ARRAY_MAX);
+	result[Mesh::ARRAY_VERTEX] = vertices;
+	result[Mesh::ARRAY_INDEX] = indices;
+	if (has[Mesh::ARRAY_NORMAL]) {
+		result[Mesh::ARRAY_NORMAL] = normals;
+	}
+	if (has[Mesh::ARRAY_TANGENT]) {
+		result[Mesh::ARRAY_TANGENT] = tangents;
+	}
+	if (has[Mesh::ARRAY_COLOR]) {
+		result[Mesh::ARRAY_COLOR] = colors;
+	}
+	if (has[Mesh::ARRAY_TEX_UV]) {
+		result[Mesh::ARRAY_TEX_UV] = uvs;
+	}
+	if (has[Mesh::ARRAY_TEX_UV2]) {
+		result[Mesh::ARRAY_TEX_UV2] = uv2s;
+	}
+	return result;
+}
+
+void TileMap3D::OctantBakeJob::process() {
+	for (uint32_t i = 0; i < surfaces.size(); i++) {
+		surfaces[i].result = _merge_surface_arrays(surfaces[i].arrays, surfaces[i].transforms);
+		surfaces[i].arrays.clear();
+		surfaces[i].transforms.clear();
+	}
+}
+
+void TileMap3D::OctantBakeJob::apply(TileMap3D *p_tilemap, Octant *p_oct) {
+	p_tilemap->_octant_clear_baked(p_oct);
+	if (surfaces.is_empty()) {
+		return;
+	}
+
+	RenderingServer *rs = RenderingServer::get_singleton();
+	// One mesh per layer, with a surface per material.
+	for (uint32_t i = 0; i < surfaces.size(); i++) {
+		if (i == 0 || surfaces[i].layer != surfaces[i - 1].layer) {
+			Octant::BakedMesh bm;
+			bm.layer = surfaces[i].layer;
+			bm.mesh.instantiate();
+			p_oct->baked_meshes.push_back(bm);
+		}
+		Ref<ArrayMesh> mesh = p_oct->baked_meshes[p_oct->baked_meshes.size() - 1].mesh;
+		mesh->add_surface_from_arrays(Mesh::PRIMITIVE_TRIANGLES, surfaces[i].result);
+		mesh->surface_set_material(mesh->get_surface_count() - 1, surfaces[i].material);
+	}
+
+	for (uint32_t i = 0; i < p_oct->baked_meshes.size(); i++) {
+		Octant::BakedMesh &bm = p_oct->baked_meshes[i];
+		bm.instance = rs->instance_create();
+		rs->instance_set_base(bm.instance, bm.mesh->get_rid());
+		p_tilemap->_apply_layer_render_settings(bm.instance, nullptr, bm.layer);
+		if (p_tilemap->is_inside_world()) {
+			rs->instance_set_scenario(bm.instance, p_tilemap->get_world_3d()->get_scenario());
+			rs->instance_set_transform(bm.instance, p_tilemap->get_global_transform());
+		}
+		if (p_tilemap->is_inside_tree()) {
+			rs->instance_set_visible(bm.instance, p_tilemap->_is_layer_visible(bm.layer));
+		}
+	}
+
+	// The baked meshes replace the multimeshes until the octant changes.
+	for (int i = 0; i < p_oct->multimesh_instances.size(); i++) {
+		p_tilemap->_multimesh_set_visible(p_oct->multimesh_instances[i], false);
+	}
+}
+
+TileMap3D::PooledMultimesh TileMap3D::_acquire_multimesh(int p_capacity) {
+	RenderingServer *rs = RenderingServer::get_singleton();
+
+	// Prefer the smallest pooled multimesh that fits, so its data can be
+	// reused as is.
+	int best = -1;
+	for (uint32_t i = 0; i < multimesh_pool.size(); i++) {
+		int capacity = multimesh_pool[i].capacity;
+		if (capacity >= p_capacity && (best < 0 || capacity < multimesh_pool[best].capacity)) {
+			best = i;
+		}
+	}
+
+	PooledMultimesh pm;
+	if (best < 0 && !multimesh_pool.is_empty()) {
+		// Nothing fits. Grow the largest one rather than creating new RIDs.
+		best = 0;
+		for (uint32_t i = 1; i < multimesh_pool.size(); i++) {
+			if (multimesh_pool[i].capacity > multimesh_pool[best].capacity) {
+				best = i;
+			}
+		}
+	}
+
+	if (best >= 0) {
+		pm = multimesh_pool[best];
+		multimesh_pool.remove_at_unordered(best);
+	} else {
+		pm.multimesh = rs->multimesh_create();
+		pm.instance = rs->instance_create();
+		rs->instance_set_base(pm.instance, pm.multimesh);
+		if (is_inside_world()) {
+			rs->instance_set_scenario(pm.instance, get_world_3d()->get_scenario());
+			rs->instance_set_transform(pm.instance, get_global_transform());
+		}
+	}
+
+	if (pm.capacity < p_capacity) {
+		rs->multimesh_allocate_data(pm.multimesh, p_capacity, RS::MULTIMESH_TRANSFORM_3D);
+		pm.capacity = p_capacity;
+	}
+	if (is_inside_tree()) {
+		rs->instance_set_visible(pm.instance, is_visible_in_tree());
+	}
+	return pm;
+}
+
+void TileMap3D::_release_multimesh(RID p_instance, RID p_multimesh, int p_capacity) {
+	RenderingServer *rs = RenderingServer::get_singleton();
+	if ((int)multimesh_pool.size() >= rid_pool_max_size) {
+		rs->free(p_instance);
+		rs->free(p_multimesh);
+		return;
+	}
 
+	// Keep the scenario and transform bindings, only hide the instances.
+	rs->multimesh_set_visible_instances(p_multimesh, 0);
+	rs->instance_set_visible(p_instance, false);
+
+	PooledMultimesh pm;
+	pm.instance = p_instance;
+	pm.multimesh = p_multimesh;
+	pm.capacity = p_capacity;
+	multimesh_pool.push_back(pm);
+}
+
+void TileMap3D::_trim_multimesh_pool(int p_size) {
+	RenderingServer *rs = RenderingServer::get_singleton();
+	while ((int)multimesh_pool.size() > p_size) {
+		const PooledMultimesh &pm = multimesh_pool[multimesh_pool.size() - 1];
+		rs->free(pm.instance);
+		rs->free(pm.multimesh);
+		multimesh_pool.resize(multimesh_pool.size() - 1);
+	}
+}
+
+void TileMap3D::_update_octant_range(uint32_t p_from, uint32_t p_to) {
+	// Patch what can be patched and clean up octants needing a rebuild.
 	List<OctantKey> to_delete;
-	for (const KeyValue<OctantKey, Octant *> &E : octant_map) {
-		if (_octant_update(E.value)) {
-			to_delete.push_back(E.key);
+	LocalVector<Octant *> to_build;
+	for (uint32_t i = p_from; i < p_to; i++) {
+		Map<OctantKey, Octant *>::Element *O = octant_map.find(dirty_octants[i]);
+		if (!O) {
+			continue;
+		}
+		Octant *oct = O->get();
+		oct->queued = false;
+		if (oct->dirty || !oct->dirty_cells.is_empty()) {
+			// Octants queued only to refresh their occluder keep their bake.
+			oct->version = ++last_octant_version;
+			_octant_clear_baked(oct);
+		}
+		// Before _octant_update() consumes the dirty state.
+		_octant_update_physics(O->key(), oct);
+		_octant_update_navigation(O->key(), oct);
+		switch (_octant_update(oct)) {
+			case OCTANT_UPDATE_EMPTY: {
+				to_delete.push_back(O->key());
+			} break;
+			case OCTANT_UPDATE_BUILD: {
+				to_build.push_back(oct);
+			} break;
+			default:
+				break;
+		}
+	}
+
+	// Group cells and compute transform buffers on worker threads, then make
+	// the server calls here.
+	thread_pool->do_work(to_build.size(), this, &TileMap3D::_octant_prepare_thread, to_build.ptr());
+	for (uint32_t i = 0; i < to_build.size(); i++) {
+		_octant_commit(to_build[i]);
+	}
+
+	// Occluders of rebuilt and patched octants are merged the same way.
+	LocalVector<Octant *> to_occlude;
+	for (uint32_t i = p_from; i < p_to; i++) {
+		Map<OctantKey, Octant *>::Element *O = octant_map.find(dirty_octants[i]);
+		if (O && O->get()->occluder_dirty && O->get()->cells.size() > 0) {
+			to_occlude.push_back(O->get());
 		}
 	}
+	thread_pool->do_work(to_occlude.size(), this, &TileMap3D::_octant_prepare_occluder_thread, to_occlude.ptr());
+	for (uint32_t i = 0; i < to_occlude.size(); i++) {
+		_octant_commit_occluder(to_occlude[i]);
+	}
 
 	while (to_delete.front()) {
 		OctantKey ok = to_delete.front()->get();
-		// Octant *oct = octant_map[ok];
-		octant_map.erase(ok);
+		Map<OctantKey, Octant *>::Element *O = octant_map.find(ok);
+		_octant_free_occluder(O->get());
+		_octant_free_physics(O->get());
+		_octant_free_navigation(O->get());
+		memdelete(O->get());
+		octant_map.erase(O);
 		to_delete.pop_front();
-		// memdelete(oct); TODO: Check if needs to be deleted
 	}
 
-	_update_visibility();
-	awaiting_update = false;
+	if (bake_meshes) {
+		for (uint32_t i = p_from; i < p_to; i++) {
+			Map<OctantKey, Octant *>::Element *O = octant_map.find(dirty_octants[i]);
+			if (O) {
+				_octant_queue_bake(O->key(), O->get());
+			}
+		}
+	}
+}
+
+void TileMap3D::_sort_dirty_octants() {
+	if (!is_inside_tree()) {
+		return;
+	}
+	Camera3D *camera = get_viewport()->get_camera_3d();
+	if (!camera) {
+		return;
+	}
+
+	// Nearest octants first.
+	Vector3 camera_pos = get_global_transform().affine_inverse().xform(camera->get_global_transform().origin);
+	LocalVector<PendingOctant> pending;
+	pending.resize(dirty_octants.size());
+	for (uint32_t i = 0; i < dirty_octants.size(); i++) {
+		pending[i].key = dirty_octants[i];
+		pending[i].distance = _get_octant_center(dirty_octants[i]).distance_squared_to(camera_pos);
+	}
+	pending.sort();
+	for (uint32_t i = 0; i < pending.size(); i++) {
+		dirty_octants[i] = pending[i].key;
+	}
+}
+
+Vector3 TileMap3D::_get_octant_center(const OctantKey &p_key) const {
+	Vector3 cell = Vector3(
+		(p_key.x + 0.5 - int(octant_center_x) * 0.5) * octant_size.x,
+		(p_key.y + 0.5 - int(octant_center_y) * 0.5) * octant_size.y,
+		(p_key.z + 0.5 - int(octant_center_z) * 0.5) * octant_size.z
+	);
+	return cell_basis[0] * cell.x + cell_basis[1] * cell.y + cell_basis[2] * cell.z + _cell_offset;
 }
 
 void TileMap3D::_update_visibility() {
@@ -82,11 +822,23 @@ void TileMap3D::_update_visibility() {
 		return;
 	}
 
+	for (const KeyValue<LightKey, ActiveLight> &E : active_lights) {
+		RS::get_singleton()->instance_set_visible(E.value.instance, is_visible_in_tree());
+	}
+
 	for (KeyValue<OctantKey, Octant *> &E : octant_map) {
 		Octant *oct = E.value;
+		bool baked = !oct->baked_meshes.is_empty();
 		for (int i = 0; i < oct->multimesh_instances.size(); i++) {
 			const Octant::MultimeshInstance &mi = oct->multimesh_instances[i];
-			RS::get_singleton()->instance_set_visible(mi.instance, is_visible_in_tree());
+			_multimesh_set_visible(mi, _is_layer_visible(mi.tile.layer) && !baked);
+		}
+		for (uint32_t i = 0; i < oct->baked_meshes.size(); i++) {
+			const Octant::BakedMesh &bm = oct->baked_meshes[i];
+			RS::get_singleton()->instance_set_visible(bm.instance, _is_layer_visible(bm.layer));
+		}
+		if (oct->occluder_instance.is_valid()) {
+			RS::get_singleton()->instance_set_visible(oct->occluder_instance, is_visible_in_tree());
 		}
 
 	// 	if (octant->collision_debug_instance.is_valid()) {
@@ -105,24 +857,39 @@ void TileMap3D::_update_visibility() {
 
 void TileMap3D::_clear_octants() {
 	for (const KeyValue<OctantKey, Octant *> &E : octant_map) {
-		if (is_inside_world()) {
-			_octant_exit_world(E.value);
-		}
-
+		// Instances are either freed or pooled with their scenario kept.
 		_octant_clean_up(E.value);
+		_octant_free_occluder(E.value);
+		_octant_free_physics(E.value);
+		_octant_free_navigation(E.value);
 		memdelete(E.value);
 	}
 
 	octant_map.clear();
+	dirty_octants.clear();
 }
 
 void TileMap3D::_octant_clean_up(Octant *p_oct) {
 	// Erase multimeshes
 	for (int i = 0; i < p_oct->multimesh_instances.size(); i++) {
-		RS::get_singleton()->free(p_oct->multimesh_instances[i].instance);
-		RS::get_singleton()->free(p_oct->multimesh_instances[i].multimesh);
+		const Octant::MultimeshInstance &mmi = p_oct->multimesh_instances[i];
+		for (uint32_t j = 0; j < mmi.cells.size(); j++) {
+			multimeshes.erase(mmi.cells[j]);
+			instance_indices.erase(mmi.cells[j]);
+		}
+		_release_multimesh(mmi.instance, mmi.multimesh, mmi.capacity);
+		if (mmi.shadow_instance.is_valid()) {
+			_release_multimesh(mmi.shadow_instance, mmi.shadow_multimesh, mmi.shadow_capacity);
+		}
 	}
 	p_oct->multimesh_instances.clear();
+	p_oct->aabb = AABB();
+
+	// Erase baked meshes
+	for (uint32_t i = 0; i < p_oct->baked_meshes.size(); i++) {
+		RS::get_singleton()->free(p_oct->baked_meshes[i].instance);
+	}
+	p_oct->baked_meshes.clear();
 
 	// Erase body shapes
 
@@ -133,13 +900,31 @@ void TileMap3D::_octant_clean_up(Octant *p_oct) {
 
 void TileMap3D::_octant_enter_world(Octant *p_oct) {
 	for (int i = 0; i < p_oct->multimesh_instances.size(); i++) {
-		RID instance = p_oct->multimesh_instances[i].instance;
+		const Octant::MultimeshInstance &mmi = p_oct->multimesh_instances[i];
+		RS::get_singleton()->instance_set_scenario(mmi.instance, get_world_3d()->get_scenario());
+		RS::get_singleton()->instance_set_transform(mmi.instance, get_global_transform());
+		if (mmi.shadow_instance.is_valid()) {
+			RS::get_singleton()->instance_set_scenario(mmi.shadow_instance, get_world_3d()->get_scenario());
+			RS::get_singleton()->instance_set_transform(mmi.shadow_instance, get_global_transform());
+		}
+	}
+	for (uint32_t i = 0; i < p_oct->baked_meshes.size(); i++) {
+		RID instance = p_oct->baked_meshes[i].instance;
 		RS::get_singleton()->instance_set_scenario(instance, get_world_3d()->get_scenario());
 		RS::get_singleton()->instance_set_transform(instance, get_global_transform());
 	}
-
-	// PhysicsServer3D::get_singleton()->body_set_state(g.static_body, PhysicsServer3D::BODY_STATE_TRANSFORM, get_global_transform());
-	// PhysicsServer3D::get_singleton()->body_set_space(g.static_body, get_world_3d()->get_space());
+	if (p_oct->occluder_instance.is_valid()) {
+		RS::get_singleton()->instance_set_scenario(p_oct->occluder_instance, get_world_3d()->get_scenario());
+		RS::get_singleton()->instance_set_transform(p_oct->occluder_instance, get_global_transform());
+	}
+	for (List<Octant::OctantPhysicsLayer>::Element *E = p_oct->physics.front(); E; E = E->next()) {
+		PhysicsServer3D::get_singleton()->body_set_state(E->get().body, PhysicsServer3D::BODY_STATE_TRANSFORM, get_global_transform());
+		PhysicsServer3D::get_singleton()->body_set_space(E->get().body, get_world_3d()->get_space());
+	}
+	for (uint32_t i = 0; i < p_oct->navigation.size(); i++) {
+		NavigationServer3D::get_singleton()->region_set_transform(p_oct->navigation[i].region, get_global_transform());
+		NavigationServer3D::get_singleton()->region_set_map(p_oct->navigation[i].region, get_world_3d()->get_navigation_map());
+	}
 
 	// if (area_enabled && g.area.is_valid()) {
 	// 	PhysicsServer3D::get_singleton()->area_set_transform(g.area->rid, get_global_transform());
@@ -155,32 +940,28 @@ void TileMap3D::_octant_enter_world(Octant *p_oct) {
 	// 	RS::get_singleton()->instance_set_scenario(g.area_debug_instance, get_world_3d()->get_scenario());
 	// 	RS::get_singleton()->instance_set_transform(g.area_debug_instance, get_global_transform());
 	// }
-
-	// if (bake_navigation && mesh_library.is_valid()) {
-	// 	for (KeyValue<IndexKey, Octant::NavMesh> &F : g.navmesh_ids) {
-	// 		if (cell_map.has(F.key) && F.value.region.is_valid() == false) {
-	// 			Ref<NavigationMesh> nm = mesh_library->get_item_navmesh(cell_map[F.key].item);
-	// 			if (nm.is_valid()) {
-	// 				RID region = NavigationServer3D::get_singleton()->region_create();
-	// 				NavigationServer3D::get_singleton()->region_set_layers(region, navigation_layers);
-	// 				NavigationServer3D::get_singleton()->region_set_navmesh(region, nm);
-	// 				NavigationServer3D::get_singleton()->region_set_transform(region, get_global_transform() * F.value.xform);
-	// 				NavigationServer3D::get_singleton()->region_set_map(region, get_world_3d()->get_navigation_map());
-
-	// 				F.value.region = region;
-	// 			}
-	// 		}
-	// 	}
-	// }
 }
 
 void TileMap3D::_octant_exit_world(Octant *p_oct) {
 	for (int i = 0; i < p_oct->multimesh_instances.size(); i++) {
-		RS::get_singleton()->instance_set_scenario(p_oct->multimesh_instances[i].instance, RID());
+		const Octant::MultimeshInstance &mmi = p_oct->multimesh_instances[i];
+		RS::get_singleton()->instance_set_scenario(mmi.instance, RID());
+		if (mmi.shadow_instance.is_valid()) {
+			RS::get_singleton()->instance_set_scenario(mmi.shadow_instance, RID());
+		}
+	}
+	for (uint32_t i = 0; i < p_oct->baked_meshes.size(); i++) {
+		RS::get_singleton()->instance_set_scenario(p_oct->baked_meshes[i].instance, RID());
+	}
+	if (p_oct->occluder_instance.is_valid()) {
+		RS::get_singleton()->instance_set_scenario(p_oct->occluder_instance, RID());
+	}
+	for (List<Octant::OctantPhysicsLayer>::Element *E = p_oct->physics.front(); E; E = E->next()) {
+		PhysicsServer3D::get_singleton()->body_set_space(E->get().body, RID());
+	}
+	for (uint32_t i = 0; i < p_oct->navigation.size(); i++) {
+		NavigationServer3D::get_singleton()->region_set_map(p_oct->navigation[i].region, RID());
 	}
-
-	// PhysicsServer3D::get_singleton()->body_set_state(g.static_body, PhysicsServer3D::BODY_STATE_TRANSFORM, get_global_transform());
-	// PhysicsServer3D::get_singleton()->body_set_space(g.static_body, RID());
 
 	// if (area_enabled && g.area.is_valid()) {
 	// 	PhysicsServer3D::get_singleton()->area_set_space(g.area->rid, RID());
@@ -193,21 +974,28 @@ void TileMap3D::_octant_exit_world(Octant *p_oct) {
 	// if (g.area_debug_instance.is_valid()) {
 	// 	RS::get_singleton()->instance_set_scenario(g.area_debug_instance, RID());
 	// }
-
-	// for (KeyValue<IndexKey, Octant::NavMesh> &F : g.navmesh_ids) {
-	// 	if (F.value.region.is_valid()) {
-	// 		NavigationServer3D::get_singleton()->free(F.value.region);
-	// 		F.value.region = RID();
-	// 	}
-	// }
 }
 
 void TileMap3D::_octant_transform(Octant *p_oct) {
 	for (int i = 0; i < p_oct->multimesh_instances.size(); i++) {
-		RS::get_singleton()->instance_set_transform(p_oct->multimesh_instances[i].instance, get_global_transform());
+		const Octant::MultimeshInstance &mmi = p_oct->multimesh_instances[i];
+		RS::get_singleton()->instance_set_transform(mmi.instance, get_global_transform());
+		if (mmi.shadow_instance.is_valid()) {
+			RS::get_singleton()->instance_set_transform(mmi.shadow_instance, get_global_transform());
+		}
+	}
+	for (uint32_t i = 0; i < p_oct->baked_meshes.size(); i++) {
+		RS::get_singleton()->instance_set_transform(p_oct->baked_meshes[i].instance, get_global_transform());
+	}
+	if (p_oct->occluder_instance.is_valid()) {
+		RS::get_singleton()->instance_set_transform(p_oct->occluder_instance, get_global_transform());
+	}
+	for (List<Octant::OctantPhysicsLayer>::Element *E = p_oct->physics.front(); E; E = E->next()) {
+		PhysicsServer3D::get_singleton()->body_set_state(E->get().body, PhysicsServer3D::BODY_STATE_TRANSFORM, get_global_transform());
+	}
+	for (uint32_t i = 0; i < p_oct->navigation.size(); i++) {
+		NavigationServer3D::get_singleton()->region_set_transform(p_oct->navigation[i].region, get_global_transform());
 	}
-
-	// PhysicsServer3D::get_singleton()->body_set_state(g.static_body, PhysicsServer3D::BODY_STATE_TRANSFORM, get_global_transform());
 
 	// if (area_enabled && g.area.is_valid()) {
 	// 	PhysicsServer3D::get_singleton()->area_set_transform(g.area->rid, get_global_transform());
@@ -222,102 +1010,1718 @@ void TileMap3D::_octant_transform(Octant *p_oct) {
 	// }
 }
 
-bool TileMap3D::_octant_update(Octant *p_oct) {
+TileMap3D::OctantUpdate TileMap3D::_octant_update(Octant *p_oct) {
 	if (!p_oct->dirty) {
-		return false;
+		if (p_oct->dirty_cells.is_empty() || _octant_patch(p_oct)) {
+			p_oct->dirty_cells.clear();
+			return OCTANT_UPDATE_NONE;
+		}
 	}
 
+	p_oct->dirty = false;
+	p_oct->dirty_cells.clear();
+	p_oct->occluder_dirty = true;
 	_octant_clean_up(p_oct);
 
 	if (p_oct->cells.size() == 0) {
-		return true;
+		return OCTANT_UPDATE_EMPTY;
 	}
+	return OCTANT_UPDATE_BUILD;
+}
+
+void TileMap3D::_octant_prepare_thread(uint32_t p_index, Octant **p_octants) {
+	_octant_prepare(p_octants[p_index]);
+}
 
-	Map<MapTile::Tile, List<Pair<Transform3D, MapCell>>> multimesh_items;
+void TileMap3D::_octant_prepare(Octant *p_oct) const {
+	// Runs on worker threads. Only reads cell storage and the tile cache.
+	p_oct->build.clear();
+	Map<MapTile::Tile, int> group_indices;
 
+	// Cells are sorted by layer and then by z, y, x, which matches the chunk
+	// layout, so consecutive lookups mostly hit the same chunk.
+	const CellChunk *chunk = nullptr;
+	int chunk_layer = -1;
 	for (Set<MapCell>::Element *E = p_oct->cells.front(); E; E = E->next()) {
 		const MapCell &cell = E->get();
 		ERR_CONTINUE(cell.layer < 0 || cell.layer >= layers.size());
 
-		const TileMapLayer &layer = layers[cell.layer];
-		const Map<MapCell, MapTile>::Element *C = layer.tile_map.find(cell);
-		ERR_CONTINUE(!C);
+		if (cell.layer != chunk_layer) {
+			chunk = nullptr;
+			chunk_layer = cell.layer;
+		}
+		const CellStorage &storage = *layers[cell.layer].cells;
+		int ci = storage.find(cell, chunk);
+		ERR_CONTINUE(ci < 0);
+
+		MapTile mt;
+		mt.tile = chunk->tiles[ci];
+		mt.tile.layer = cell.layer; // Stored layers go stale when layers move.
+		mt.rot_idx = chunk->rotations[ci];
+		const TileCache *cache = _get_tile_cache(mt.tile);
+		if (!cache || !cache->mesh.is_valid()) {
+			continue;
+		}
+		if (_is_culling_hidden_cells() && _is_cell_hidden(cell)) {
+			continue;
+		}
 
-		const MapTile &mt = C->get();
-		Ref<TileData3DMesh> data = tile_set->get_collection_tile(mt.tile.collection_id, mt.tile.tile_id, mt.tile.alternative_id);
-		ERR_CONTINUE(data.is_null());
+		Map<MapTile::Tile, int>::Element *G = group_indices.find(mt.tile);
+		if (!G) {
+			G = group_indices.insert(mt.tile, p_oct->build.size());
+			Octant::MultimeshBuild mmb;
+			mmb.tile = mt.tile;
+			mmb.cache = cache;
+			p_oct->build.push_back(mmb);
+		}
+		Octant::MultimeshBuild &mmb = p_oct->build[G->get()];
+		mmb.cells.push_back(cell);
+		mmb.rotations.push_back(mt.rot_idx);
+	}
 
-		Vector3 origin = cell_to_local(cell);
-		Transform3D transform = Transform3D(mt.rotation, origin);
-		transform.basis.scale(Vector3(cell_scale, cell_scale, cell_scale));
-		if (data->get_mesh().is_valid()) {
-			Map<MapTile::Tile, List<Pair<Transform3D, MapCell>>>::Element *MME = multimesh_items.find(mt.tile);
-			if (!MME) {
-				MME = multimesh_items.insert(mt.tile, List<Pair<Transform3D, MapCell>>());
+	LocalVector<Vector3i> positions;
+	LocalVector<Vector3> origins;
+	for (uint32_t i = 0; i < p_oct->build.size(); i++) {
+		Octant::MultimeshBuild &mmb = p_oct->build[i];
+
+		// Leave room for cells added later, so they can be appended without
+		// reallocating the multimesh.
+		int count = mmb.cells.size();
+		mmb.capacity = count + MAX(count / 4, 4);
+
+		// Every transform is uploaded with a single call instead of one
+		// RenderingServer command per instance. Spare slots are left zeroed.
+		mmb.buffer.resize(mmb.capacity * INSTANCE_TRANSFORM_STRIDE);
+		float *w = mmb.buffer.ptrw();
+		memset(w, 0, mmb.buffer.size() * sizeof(float));
+
+		positions.resize(count);
+		origins.resize(count);
+		for (int j = 0; j < count; j++) {
+			positions[j] = mmb.cells[j];
+		}
+		cells_to_local(positions.ptr(), origins.ptr(), count);
+
+		MapTile mt;
+		mt.tile = mmb.tile;
+		for (int j = 0; j < count; j++) {
+			mt.rot_idx = mmb.rotations[j];
+			Transform3D transform = _get_cell_transform(mmb.cells[j], mt, *mmb.cache, origins[j]);
+			_write_instance_transform(w + j * INSTANCE_TRANSFORM_STRIDE, transform);
+
+			AABB aabb = _get_instance_aabb(mt, *mmb.cache, transform);
+			if (j == 0) {
+				mmb.aabb = aabb;
+			} else {
+				mmb.aabb.merge_with(aabb);
 			}
-			Pair<Transform3D, MapCell> p;
-			p.first = transform * data->get_mesh_transform();
-			p.second = cell;
-			MME->get().push_back(p);
 		}
+		mmb.rotations.clear();
 	}
+}
 
+void TileMap3D::_octant_commit(Octant *p_oct) {
 	RenderingServer *rs = RenderingServer::get_singleton();
-	for (const KeyValue<MapTile::Tile, List<Pair<Transform3D, MapCell>>> &E : multimesh_items) {
+	for (uint32_t i = 0; i < p_oct->build.size(); i++) {
+		Octant::MultimeshBuild &mmb = p_oct->build[i];
+		int count = mmb.cells.size();
+
+		PooledMultimesh pm = _acquire_multimesh(mmb.capacity);
+		if (pm.capacity > mmb.capacity) {
+			// Reused a larger multimesh, pad the buffer with empty instances.
+			int size = mmb.buffer.size();
+			mmb.buffer.resize(pm.capacity * INSTANCE_TRANSFORM_STRIDE);
+			memset(mmb.buffer.ptrw() + size, 0, (mmb.buffer.size() - size) * sizeof(float));
+		}
+		rs->multimesh_set_buffer(pm.multimesh, mmb.buffer);
+		rs->multimesh_set_visible_instances(pm.multimesh, count);
+		rs->multimesh_set_mesh(pm.multimesh, mmb.cache->mesh);
+		_apply_render_settings(pm.instance, *mmb.cache, mmb.tile.layer);
+		// Known bounds spare the server from walking every instance.
+		rs->instance_set_custom_aabb(pm.instance, mmb.aabb);
+
 		Octant::MultimeshInstance mmi;
-		const MapTile::Tile &tile = E.key;
-		Ref<TileData3DMesh> data = tile_set->get_collection_tile(tile.collection_id, tile.tile_id, tile.alternative_id);
-		RID mm = rs->multimesh_create();
-		rs->multimesh_allocate_data(mm, E.value.size(), RS::MULTIMESH_TRANSFORM_3D);
-		rs->multimesh_set_mesh(mm, data->get_mesh()->get_rid());
-
-		RID instance = rs->instance_create();
-		rs->instance_set_base(instance, mm);
-
-		int idx = 0;
-		for (const Pair<Transform3D, MapCell> &F : E.value) {
-			rs->multimesh_instance_set_transform(mm, idx, F.first);
-			multimeshes[F.second] = instance;
-			instance_indices[F.second] = idx;
-			idx++;
+		if (mmb.cache->shadow_mesh.is_valid()) {
+			// Same transforms, the proxy is drawn in shadow passes only and
+			// the full mesh stops casting shadows.
+			PooledMultimesh shadow_pm = _acquire_multimesh(pm.capacity);
+			Vector<float> shadow_buffer = mmb.buffer;
+			if (shadow_pm.capacity > pm.capacity) {
+				int size = shadow_buffer.size();
+				shadow_buffer.resize(shadow_pm.capacity * INSTANCE_TRANSFORM_STRIDE);
+				memset(shadow_buffer.ptrw() + size, 0, (shadow_buffer.size() - size) * sizeof(float));
+			}
+			rs->multimesh_set_buffer(shadow_pm.multimesh, shadow_buffer);
+			rs->multimesh_set_visible_instances(shadow_pm.multimesh, count);
+			rs->multimesh_set_mesh(shadow_pm.multimesh, mmb.cache->shadow_mesh);
+			_apply_render_settings(shadow_pm.instance, *mmb.cache, mmb.tile.layer);
+			rs->instance_geometry_set_cast_shadows_setting(shadow_pm.instance, RS::SHADOW_CASTING_SETTING_SHADOWS_ONLY);
+			rs->instance_geometry_set_cast_shadows_setting(pm.instance, RS::SHADOW_CASTING_SETTING_OFF);
+			// The proxy may not match the mesh bounds, let the server compute them.
+			rs->instance_set_custom_aabb(shadow_pm.instance, AABB());
+
+			mmi.shadow_instance = shadow_pm.instance;
+			mmi.shadow_multimesh = shadow_pm.multimesh;
+			mmi.shadow_capacity = shadow_pm.capacity;
+		}
+
+		for (int j = 0; j < count; j++) {
+			multimeshes[mmb.cells[j]] = pm.instance;
+			instance_indices[mmb.cells[j]] = j;
+		}
+
+		mmi.multimesh = pm.multimesh;
+		mmi.instance = pm.instance;
+		mmi.tile = mmb.tile;
+		mmi.capacity = pm.capacity;
+		mmi.cells = mmb.cells;
+		mmi.aabb = mmb.aabb;
+		if (is_inside_tree() && !layers[mmb.tile.layer].enabled) {
+			_multimesh_set_visible(mmi, false);
+		}
+		if (p_oct->multimesh_instances.is_empty()) {
+			p_oct->aabb = mmb.aabb;
+		} else {
+			p_oct->aabb.merge_with(mmb.aabb);
+		}
+		p_oct->multimesh_instances.push_back(mmi);
+	}
+	p_oct->build.clear();
+}
+
+// Corner i is center + (i & 1 ? e0 : -e0) + (i & 2 ? e1 : -e1) + (i & 4 ? e2 : -e2).
+static const int box_indices[36] = {
+	0, 4, 6, 0, 6, 2, // -x
+	1, 3, 7, 1, 7, 5, // +x
+	0, 1, 5, 0, 5, 4, // -y
+	2, 6, 7, 2, 7, 3, // +y
+	0, 2, 3, 0, 3, 1, // -z
+	4, 5, 7, 4, 7, 6, // +z
+};
+
+// Shapes made of triangles, or that can be turned into triangles exactly.
+static bool _is_trimesh_shape(const Shape3D *p_shape) {
+	return Object::cast_to<ConcavePolygonShape3D>(p_shape) || Object::cast_to<ConvexPolygonShape3D>(p_shape) || Object::cast_to<BoxShape3D>(p_shape);
+}
+
+static void _append_shape_faces(const Shape3D *p_shape, const Transform3D &p_transform, PackedVector3Array &r_faces) {
+	if (const ConcavePolygonShape3D *concave = Object::cast_to<ConcavePolygonShape3D>(p_shape)) {
+		Vector<Vector3> faces = concave->get_faces();
+		int base = r_faces.size();
+		r_faces.resize(base + faces.size());
+		Vector3 *w = r_faces.ptrw() + base;
+		for (int i = 0; i < faces.size(); i++) {
+			w[i] = p_transform.xform(faces[i]);
+		}
+	} else if (const ConvexPolygonShape3D *convex = Object::cast_to<ConvexPolygonShape3D>(p_shape)) {
+		Geometry3D::MeshData md;
+		if (ConvexHullComputer::convex_hull(convex->get_points(), md) != OK) {
+			return;
+		}
+		for (int i = 0; i < md.faces.size(); i++) {
+			const Vector<int> &indices = md.faces[i].indices;
+			for (int j = 2; j < indices.size(); j++) {
+				r_faces.push_back(p_transform.xform(md.vertices[indices[0]]));
+				r_faces.push_back(p_transform.xform(md.vertices[indices[j - 1]]));
+				r_faces.push_back(p_transform.xform(md.vertices[indices[j]]));
+			}
+		}
+	} else if (const BoxShape3D *box = Object::cast_to<BoxShape3D>(p_shape)) {
+		Vector3 half_size = box->get_size() * 0.5;
+		Vector3 corners[8];
+		for (int i = 0; i < 8; i++) {
+			corners[i] = p_transform.xform(Vector3(i & 1 ? half_size.x : -half_size.x, i & 2 ? half_size.y : -half_size.y, i & 4 ? half_size.z : -half_size.z));
+		}
+		int base = r_faces.size();
+		r_faces.resize(base + 36);
+		Vector3 *w = r_faces.ptrw() + base;
+		for (int i = 0; i < 36; i++) {
+			w[i] = corners[box_indices[i]];
+		}
+	}
+}
+
+void TileMap3D::_octant_update_physics(const OctantKey &p_key, Octant *p_oct) {
+	if (p_oct->dirty || p_oct->physics_dirty) {
+		p_oct->physics_dirty = false;
+		_octant_reset_physics(p_oct);
+		for (Set<MapCell>::Element *E = p_oct->cells.front(); E; E = E->next()) {
+			_octant_add_cell_shapes(p_oct, E->get());
+		}
+	} else {
+		// Only the shapes of the edited cells change.
+		for (Set<MapCell>::Element *E = p_oct->dirty_cells.front(); E; E = E->next()) {
+			_octant_remove_cell_shapes(p_oct, E->get());
+			_octant_add_cell_shapes(p_oct, E->get());
+		}
+	}
+
+	// Boxes are merged again over the whole octant once its cells are in.
+	bool bake_trimesh = false;
+	for (List<Octant::OctantPhysicsLayer>::Element *E = p_oct->physics.front(); E; E = E->next()) {
+		if (E->get().boxes_dirty) {
+			_octant_merge_physics_boxes(&E->get());
+		}
+		bake_trimesh = bake_trimesh || E->get().trimesh_dirty;
+	}
+	// A pending collision job is dropped once the octant version changes, so
+	// it is queued again even if no trimesh cell changed.
+	if (bake_trimesh || (p_oct->collision_bake_version != 0 && p_oct->collision_bake_version != p_oct->version)) {
+		_octant_queue_collision_bake(p_key, p_oct);
+	}
+}
+
+void TileMap3D::_octant_reset_physics(Octant *p_oct) {
+	// Bodies and their slots are kept, a baked trimesh stays until the one
+	// replacing it is ready.
+	bool baking = collision_mode == COLLISION_MODE_BAKED_TRIMESH;
+	for (List<Octant::OctantPhysicsLayer>::Element *E = p_oct->physics.front(); E; E = E->next()) {
+		Octant::OctantPhysicsLayer &pl = E->get();
+		for (KeyValue<MapCell, LocalVector<int>> &C : pl.cell_shapes) {
+			for (uint32_t i = 0; i < C.value.size(); i++) {
+				_physics_layer_remove_shape(&pl, C.value[i]);
+			}
+		}
+		pl.cell_shapes.clear();
+		if (pl.box_cells.size() > 0) {
+			pl.box_cells.clear();
+			pl.boxes_dirty = true;
+		}
+		if (pl.trimesh_cells.size() > 0) {
+			pl.trimesh_cells.clear();
+			pl.trimesh_dirty = true;
+		}
+		if (!baking) {
+			_octant_set_trimesh(&pl, PackedVector3Array());
+		}
+	}
+}
+
+void TileMap3D::_octant_add_cell_shapes(Octant *p_oct, const MapCell &p_cell) {
+	MapTile mt;
+	const TileCache *cache = _get_cell_data(p_cell, mt);
+	if (!cache || cache->data->get_physics_data_count() == 0) {
+		return;
+	}
+
+	const Ref<TileData3DMesh> &data = cache->data;
+	Transform3D cell_transform = _get_cell_base_transform(p_cell, mt);
+	bool merge_boxes = _is_merging_collision_boxes();
+	bool bake_trimesh = collision_mode == COLLISION_MODE_BAKED_TRIMESH;
+	for (int i = 0; i < data->get_physics_data_count(); i++) {
+		Vector<TileData3DMesh::ShapeData> shapes = data->get_physics_data_shapes(i);
+		if (shapes.is_empty()) {
+			continue;
+		}
+		Octant::OctantPhysicsLayer *pl = _octant_get_physics_layer(p_oct, data->get_physics_data_layer_id(i), data->get_physics_data_linear_velocity(i), data->get_physics_data_angular_velocity(i));
+		if (merge_boxes && _is_full_cell_box(shapes, cell_transform.basis)) {
+			pl->box_cells.insert(p_cell);
+			pl->boxes_dirty = true;
+			continue;
+		}
+
+		LocalVector<int> *cell_shapes = nullptr;
+		bool baked = false;
+		for (int j = 0; j < shapes.size(); j++) {
+			if (shapes[j].shape.is_null()) {
+				continue;
+			}
+			if (bake_trimesh && _is_trimesh_shape(shapes[j].shape.ptr())) {
+				baked = true;
+				continue;
+			}
+			// Shape3D resources own their RID, so cells using the same
+			// resource share it.
+			int idx = _physics_layer_add_shape(pl, shapes[j].shape->get_rid(), cell_transform * shapes[j].local_transform);
+			pl->shapes_cell[idx] = p_cell;
+			if (!cell_shapes) {
+				cell_shapes = &pl->cell_shapes[p_cell];
+			}
+			cell_shapes->push_back(idx);
+		}
+		if (baked) {
+			pl->trimesh_cells.insert(p_cell);
+			pl->trimesh_dirty = true;
+		}
+	}
+}
+
+bool TileMap3D::_is_full_cell_box(const Vector<TileData3DMesh::ShapeData> &p_shapes, const Basis &p_cell_basis) const {
+	if (p_shapes.size() != 1) {
+		return false;
+	}
+	const BoxShape3D *box = Object::cast_to<BoxShape3D>(p_shapes[0].shape.ptr());
+	if (!box) {
+		return false;
+	}
+
+	// The placed box must be centered on the cell and have its edges along
+	// the cell axes, with the same lengths.
+	Transform3D transform = Transform3D(p_cell_basis) * p_shapes[0].local_transform;
+	if (!transform.origin.is_equal_approx(Vector3())) {
+		return false;
+	}
+	Vector3 box_size = box->get_size();
+	bool matched[3] = { false, false, false };
+	for (int i = 0; i < 3; i++) {
+		Vector3 edge = transform.basis.get_axis(i) * box_size[i];
+		bool found = false;
+		for (int j = 0; j < 3 && !found; j++) {
+			if (!matched[j] && (edge.is_equal_approx(cell_basis[j]) || edge.is_equal_approx(-cell_basis[j]))) {
+				matched[j] = true;
+				found = true;
+			}
+		}
+		if (!found) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void TileMap3D::_octant_merge_physics_boxes(Octant::OctantPhysicsLayer *p_layer) {
+	p_layer->boxes_dirty = false;
+	// Boxes are merged per map layer so each one maps back to a layer. Cells
+	// are ordered by layer first.
+	LocalVector<CellBox> boxes;
+	LocalVector<int> box_layers;
+	LocalVector<Vector3i> cells;
+	LocalVector<CellBox> layer_boxes;
+	for (Set<MapCell>::Element *E = p_layer->box_cells.front(); E; E = E->next()) {
+		cells.push_back(E->get());
+		if (!E->next() || E->next()->get().layer != E->get().layer) {
+			_merge_cell_boxes(cells, layer_boxes, 0x7, 3 - cell_plane_axes[0] - cell_plane_axes[1]);
+			for (uint32_t i = 0; i < layer_boxes.size(); i++) {
+				boxes.push_back(layer_boxes[i]);
+				box_layers.push_back(E->get().layer);
+			}
+			cells.clear();
+		}
+	}
+
+	// Cuboid cell axes are orthogonal, so each box is a rotated BoxShape3D.
+	PhysicsServer3D *ps = PhysicsServer3D::get_singleton();
+	Basis box_basis;
+	for (int i = 0; i < 3; i++) {
+		box_basis.set_axis(i, cell_basis[i].normalized());
+	}
+	if (box_basis.determinant() < 0) {
+		// Inverted axes, boxes are symmetric so one can be flipped back.
+		box_basis.set_axis(0, -box_basis.get_axis(0));
+	}
+	for (uint32_t i = 0; i < boxes.size(); i++) {
+		const CellBox &box = boxes[i];
+		Vector3 half_size = Vector3(box.size) * 0.5;
+		Vector3 extents;
+		for (int j = 0; j < 3; j++) {
+			extents[j] = cell_basis[j].length() * half_size[j];
+		}
+		Transform3D transform = Transform3D(box_basis, cell_to_local(box.position) + cell_basis[0] * (half_size.x - 0.5) + cell_basis[1] * (half_size.y - 0.5) + cell_basis[2] * (half_size.z - 0.5));
+
+		if (i == p_layer->box_shapes.size()) {
+			RID shape = ps->box_shape_create();
+			ps->shape_set_data(shape, extents);
+			p_layer->box_shapes.push_back(shape);
+			p_layer->box_slots.push_back(_physics_layer_add_shape(p_layer, shape, transform));
+		} else {
+			int idx = p_layer->box_slots[i];
+			ps->shape_set_data(p_layer->box_shapes[i], extents);
+			ps->body_set_shape_transform(p_layer->body, idx, transform);
+			ps->body_set_shape_disabled(p_layer->body, idx, false);
+		}
+		// Collisions with a box report the cell it starts from.
+		p_layer->shapes_cell[p_layer->box_slots[i]] = MapCell(box.position, box_layers[i]);
+	}
+	for (uint32_t i = boxes.size(); i < p_layer->box_shapes.size(); i++) {
+		ps->body_set_shape_disabled(p_layer->body, p_layer->box_slots[i], true);
+		p_layer->shapes_cell.erase(p_layer->box_slots[i]);
+	}
+}
+
+int TileMap3D::_physics_layer_add_shape(Octant::OctantPhysicsLayer *p_layer, RID p_shape, const Transform3D &p_transform) {
+	PhysicsServer3D *ps = PhysicsServer3D::get_singleton();
+	if (p_layer->free_shapes.is_empty()) {
+		ps->body_add_shape(p_layer->body, p_shape, p_transform);
+		return ps->body_get_shape_count(p_layer->body) - 1;
+	}
+	int idx = p_layer->free_shapes[p_layer->free_shapes.size() - 1];
+	p_layer->free_shapes.resize(p_layer->free_shapes.size() - 1);
+	ps->body_set_shape(p_layer->body, idx, p_shape);
+	ps->body_set_shape_transform(p_layer->body, idx, p_transform);
+	ps->body_set_shape_disabled(p_layer->body, idx, false);
+	return idx;
+}
+
+void TileMap3D::_physics_layer_remove_shape(Octant::OctantPhysicsLayer *p_layer, int p_index) {
+	PhysicsServer3D::get_singleton()->body_set_shape_disabled(p_layer->body, p_index, true);
+	p_layer->shapes_cell.erase(p_index);
+	p_layer->free_shapes.push_back(p_index);
+}
+
+void TileMap3D::_octant_remove_cell_shapes(Octant *p_oct, const MapCell &p_cell) {
+	for (List<Octant::OctantPhysicsLayer>::Element *E = p_oct->physics.front(); E; E = E->next()) {
+		Octant::OctantPhysicsLayer &pl = E->get();
+		if (pl.box_cells.erase(p_cell)) {
+			pl.boxes_dirty = true;
+		}
+		if (pl.trimesh_cells.erase(p_cell)) {
+			pl.trimesh_dirty = true;
+		}
+		Map<MapCell, LocalVector<int>>::Element *C = pl.cell_shapes.find(p_cell);
+		if (!C) {
+			continue;
+		}
+		for (uint32_t i = 0; i < C->get().size(); i++) {
+			_physics_layer_remove_shape(&pl, C->get()[i]);
+		}
+		pl.cell_shapes.erase(C);
+	}
+}
+
+TileMap3D::Octant::OctantPhysicsLayer *TileMap3D::_octant_get_physics_layer(Octant *p_oct, int p_layer_id, const Vector3 &p_linear_velocity, const Vector3 &p_angular_velocity) {
+	for (List<Octant::OctantPhysicsLayer>::Element *E = p_oct->physics.front(); E; E = E->next()) {
+		Octant::OctantPhysicsLayer &pl = E->get();
+		if (pl.layer_id == p_layer_id && pl.linear_velocity == p_linear_velocity && pl.angular_velocity == p_angular_velocity) {
+			return &pl;
+		}
+	}
+
+	PhysicsServer3D *ps = PhysicsServer3D::get_singleton();
+	Octant::OctantPhysicsLayer pl;
+	pl.layer_id = p_layer_id;
+	pl.linear_velocity = p_linear_velocity;
+	pl.angular_velocity = p_angular_velocity;
+	pl.body = ps->body_create();
+	ps->body_set_mode(pl.body, PhysicsServer3D::BODY_MODE_STATIC);
+	ps->body_attach_object_instance_id(pl.body, get_instance_id());
+	ps->body_set_collision_layer(pl.body, collision_layer);
+	ps->body_set_collision_mask(pl.body, collision_mask);
+	// Static bodies with a velocity move what touches them, like conveyors.
+	ps->body_set_state(pl.body, PhysicsServer3D::BODY_STATE_LINEAR_VELOCITY, p_linear_velocity);
+	ps->body_set_state(pl.body, PhysicsServer3D::BODY_STATE_ANGULAR_VELOCITY, p_angular_velocity);
+	if (is_inside_world()) {
+		ps->body_set_state(pl.body, PhysicsServer3D::BODY_STATE_TRANSFORM, get_global_transform());
+		ps->body_set_space(pl.body, get_world_3d()->get_space());
+	}
+	return &p_oct->physics.push_back(pl)->get();
+}
+
+void TileMap3D::_octant_free_physics(Octant *p_oct) {
+	PhysicsServer3D *ps = PhysicsServer3D::get_singleton();
+	for (List<Octant::OctantPhysicsLayer>::Element *E = p_oct->physics.front(); E; E = E->next()) {
+		// The body goes first, so freeing the box shapes does not remove
+		// them from it one by one.
+		ps->free(E->get().body);
+		for (uint32_t i = 0; i < E->get().box_shapes.size(); i++) {
+			ps->free(E->get().box_shapes[i]);
+		}
+		if (E->get().trimesh_shape.is_valid()) {
+			ps->free(E->get().trimesh_shape);
+		}
+	}
+	p_oct->physics.clear();
+}
+
+void TileMap3D::_octant_queue_collision_bake(const OctantKey &p_key, Octant *p_oct) {
+	p_oct->collision_bake_version = p_oct->version;
+
+	OctantCollisionJob *job = memnew(OctantCollisionJob);
+	job->key = p_key;
+	job->version = p_oct->version;
+
+	// Every layer with a trimesh is rebuilt, the job replaces any dropped one.
+	for (List<Octant::OctantPhysicsLayer>::Element *E = p_oct->physics.front(); E; E = E->next()) {
+		Octant::OctantPhysicsLayer &pl = E->get();
+		pl.trimesh_dirty = false;
+		if (pl.trimesh_cells.size() == 0 && !pl.trimesh_shape.is_valid()) {
+			continue;
+		}
+		OctantCollisionJob::PhysicsLayer jl;
+		jl.layer_id = pl.layer_id;
+		jl.linear_velocity = pl.linear_velocity;
+		jl.angular_velocity = pl.angular_velocity;
+		for (Set<MapCell>::Element *C = pl.trimesh_cells.front(); C; C = C->next()) {
+			MapTile mt;
+			if (!_get_cell_data(C->get(), mt)) {
+				continue;
+			}
+			TileCache *cache = tile_cache.find(_get_tile_cache_key(mt.tile))->get();
+			_cache_tile_collision_faces(cache);
+			Transform3D cell_transform = _get_cell_base_transform(C->get(), mt);
+			const Ref<TileData3DMesh> &data = cache->data;
+			for (int i = 0; i < cache->collision_faces.size(); i++) {
+				if (cache->collision_faces[i].is_empty() || data->get_physics_data_layer_id(i) != pl.layer_id || data->get_physics_data_linear_velocity(i) != pl.linear_velocity || data->get_physics_data_angular_velocity(i) != pl.angular_velocity) {
+					continue;
+				}
+				jl.faces.push_back(cache->collision_faces[i]);
+				jl.transforms.push_back(cell_transform);
+			}
+		}
+		job->physics_layers.push_back(jl);
+	}
+
+	_queue_octant_job(job);
+}
+
+void TileMap3D::_octant_set_trimesh(Octant::OctantPhysicsLayer *p_layer, const PackedVector3Array &p_faces) {
+	PhysicsServer3D *ps = PhysicsServer3D::get_singleton();
+	if (p_faces.is_empty()) {
+		if (p_layer->trimesh_slot >= 0) {
+			ps->body_set_shape_disabled(p_layer->body, p_layer->trimesh_slot, true);
+		}
+		return;
+	}
+
+	// Closed tile shapes are merged, faces may be seen from inside at seams.
+	Dictionary d;
+	d["faces"] = p_faces;
+	d["backface_collision"] = true;
+	if (!p_layer->trimesh_shape.is_valid()) {
+		p_layer->trimesh_shape = ps->concave_polygon_shape_create();
+		ps->shape_set_data(p_layer->trimesh_shape, d);
+		p_layer->trimesh_slot = _physics_layer_add_shape(p_layer, p_layer->trimesh_shape, Transform3D());
+	} else {
+		// Replaces the faces in a single call, bodies never see a partial
+		// shape.
+		ps->shape_set_data(p_layer->trimesh_shape, d);
+		ps->body_set_shape_disabled(p_layer->body, p_layer->trimesh_slot, false);
+	}
+}
+
+void TileMap3D::_cache_tile_collision_faces(TileCache *p_cache) {
+	if (!p_cache->collision_faces.is_empty()) {
+		return;
+	}
+	const Ref<TileData3DMesh> &data = p_cache->data;
+	p_cache->collision_faces.resize(data->get_physics_data_count());
+	for (int i = 0; i < data->get_physics_data_count(); i++) {
+		PackedVector3Array faces;
+		Vector<TileData3DMesh::ShapeData> shapes = data->get_physics_data_shapes(i);
+		for (int j = 0; j < shapes.size(); j++) {
+			if (shapes[j].shape.is_valid()) {
+				_append_shape_faces(shapes[j].shape.ptr(), shapes[j].local_transform, faces);
+			}
+		}
+		p_cache->collision_faces.write[i] = faces;
+	}
+}
+
+void TileMap3D::OctantCollisionJob::process() {
+	for (uint32_t i = 0; i < physics_layers.size(); i++) {
+		PhysicsLayer &jl = physics_layers[i];
+		int count = 0;
+		for (uint32_t j = 0; j < jl.faces.size(); j++) {
+			count += jl.faces[j].size();
+		}
+		jl.result.resize(count);
+		Vector3 *w = jl.result.ptrw();
+		for (uint32_t j = 0; j < jl.faces.size(); j++) {
+			const Transform3D &xform = jl.transforms[j];
+			const Vector3 *r = jl.faces[j].ptr();
+			int fc = jl.faces[j].size();
+			if (xform.basis.determinant() < 0.0) {
+				// Mirroring transforms flip the winding order.
+				for (int k = 0; k + 2 < fc; k += 3) {
+					w[k] = xform.xform(r[k]);
+					w[k + 1] = xform.xform(r[k + 2]);
+					w[k + 2] = xform.xform(r[k + 1]);
+				}
+			} else {
+				for (int k = 0; k < fc; k++) {
+					w[k] = xform.xform(r[k]);
+				}
+			}
+			w += fc;
+		}
+		jl.faces.clear();
+		jl.transforms.clear();
+	}
+}
+
+void TileMap3D::OctantCollisionJob::apply(TileMap3D *p_tilemap, Octant *p_oct) {
+	p_oct->collision_bake_version = 0;
+	if (p_tilemap->collision_mode != COLLISION_MODE_BAKED_TRIMESH) {
+		return;
+	}
+	for (uint32_t i = 0; i < physics_layers.size(); i++) {
+		const PhysicsLayer &jl = physics_layers[i];
+		Octant::OctantPhysicsLayer *pl = p_tilemap->_octant_get_physics_layer(p_oct, jl.layer_id, jl.linear_velocity, jl.angular_velocity);
+		p_tilemap->_octant_set_trimesh(pl, jl.result);
+	}
+}
+
+void TileMap3D::_octant_update_navigation(const OctantKey &p_key, Octant *p_oct) {
+	// A pending job is dropped once the octant version changes.
+	bool dropped = p_oct->navigation_version != 0 && p_oct->navigation_version != p_oct->version;
+	if (!p_oct->dirty && p_oct->dirty_cells.is_empty() && !dropped) {
+		return;
+	}
+
+	bool has_navigation = !p_oct->navigation.is_empty() || dropped;
+	const Set<MapCell> &cells = p_oct->dirty ? p_oct->cells : p_oct->dirty_cells;
+	for (const Set<MapCell>::Element *E = cells.front(); E && !has_navigation; E = E->next()) {
+		MapTile mt;
+		const TileCache *cache = _get_cell_data(E->get(), mt);
+		has_navigation = cache && cache->data->get_navigation_data_count() > 0;
+	}
+	if (has_navigation) {
+		_octant_queue_navigation(p_key, p_oct);
+	}
+}
+
+void TileMap3D::_octant_queue_navigation(const OctantKey &p_key, Octant *p_oct) {
+	p_oct->navigation_version = p_oct->version;
+
+	OctantNavigationJob *job = memnew(OctantNavigationJob);
+	job->key = p_key;
+	job->version = p_oct->version;
+
+	// The whole octant is merged again, regions are small enough for it.
+	for (Set<MapCell>::Element *E = p_oct->cells.front(); E; E = E->next()) {
+		MapTile mt;
+		if (!_get_cell_data(E->get(), mt)) {
+			continue;
+		}
+		TileCache *cache = tile_cache.find(_get_tile_cache_key(mt.tile))->get();
+		if (cache->data->get_navigation_data_count() == 0) {
+			continue;
+		}
+		_cache_tile_navigation(cache);
+		Transform3D cell_transform = _get_cell_base_transform(E->get(), mt);
+		for (int i = 0; i < cache->navigation_vertices.size(); i++) {
+			if (cache->navigation_vertices[i].is_empty()) {
+				continue;
+			}
+			int layer_id = cache->data->get_navigation_data_layer_id(i);
+			OctantNavigationJob::NavigationLayer *jl = nullptr;
+			for (uint32_t j = 0; j < job->navigation_layers.size(); j++) {
+				if (job->navigation_layers[j].layer_id == layer_id) {
+					jl = &job->navigation_layers[j];
+					break;
+				}
+			}
+			if (!jl) {
+				job->navigation_layers.push_back(OctantNavigationJob::NavigationLayer());
+				jl = &job->navigation_layers[job->navigation_layers.size() - 1];
+				jl->layer_id = layer_id;
+			}
+			jl->vertices.push_back(cache->navigation_vertices[i]);
+			jl->polygons.push_back(cache->navigation_polygons[i]);
+			jl->transforms.push_back(cell_transform);
+		}
+	}
+
+	_queue_octant_job(job);
+}
+
+void TileMap3D::_octant_free_navigation(Octant *p_oct) {
+	for (uint32_t i = 0; i < p_oct->navigation.size(); i++) {
+		NavigationServer3D::get_singleton()->free(p_oct->navigation[i].region);
+	}
+	p_oct->navigation.clear();
+}
+
+void TileMap3D::_cache_tile_navigation(TileCache *p_cache) {
+	if (!p_cache->navigation_vertices.is_empty()) {
+		return;
+	}
+	const Ref<TileData3DMesh> &data = p_cache->data;
+	p_cache->navigation_vertices.resize(data->get_navigation_data_count());
+	p_cache->navigation_polygons.resize(data->get_navigation_data_count());
+	for (int i = 0; i < data->get_navigation_data_count(); i++) {
+		Ref<NavigationMesh> navmesh = data->get_navigation_data_navmesh(i);
+		int layer_id = data->get_navigation_data_layer_id(i);
+		// Layer ids are navigation layer bits, -1 leaves the entry unused.
+		if (navmesh.is_null() || layer_id < 0) {
+			continue;
+		}
+		ERR_CONTINUE_MSG(layer_id >= 32, vformat("Navigation layer id %d is out of range, only 32 navigation layers exist.", layer_id));
+
+		Transform3D transform = data->get_navigation_data_navmesh_transform(i);
+		PackedVector3Array vertices = navmesh->get_vertices();
+		Vector3 *wv = vertices.ptrw();
+		for (int j = 0; j < vertices.size(); j++) {
+			wv[j] = transform.xform(wv[j]);
+		}
+
+		PackedInt32Array polygons;
+		for (int j = 0; j < navmesh->get_polygon_count(); j++) {
+			Vector<int> polygon = navmesh->get_polygon(j);
+			polygons.push_back(polygon.size());
+			for (int k = 0; k < polygon.size(); k++) {
+				polygons.push_back(polygon[k]);
+			}
+		}
+		p_cache->navigation_vertices.write[i] = vertices;
+		p_cache->navigation_polygons.write[i] = polygons;
+	}
+}
+
+void TileMap3D::OctantNavigationJob::process() {
+	for (uint32_t i = 0; i < navigation_layers.size(); i++) {
+		NavigationLayer &jl = navigation_layers[i];
+		int vertex_count = 0;
+		for (uint32_t j = 0; j < jl.vertices.size(); j++) {
+			vertex_count += jl.vertices[j].size();
+		}
+		jl.result_vertices.resize(vertex_count);
+		Vector3 *wv = jl.result_vertices.ptrw();
+
+		int vofs = 0;
+		for (uint32_t j = 0; j < jl.vertices.size(); j++) {
+			const Transform3D &xform = jl.transforms[j];
+			const Vector3 *rv = jl.vertices[j].ptr();
+			int vc = jl.vertices[j].size();
+			for (int k = 0; k < vc; k++) {
+				wv[vofs + k] = xform.xform(rv[k]);
+			}
+			// Mirroring transforms flip the winding order.
+			bool flip = xform.basis.determinant() < 0.0;
+
+			const int *rp = jl.polygons[j].ptr();
+			int pc = jl.polygons[j].size();
+			for (int k = 0; k < pc; k += rp[k] + 1) {
+				Vector<int> polygon;
+				polygon.resize(rp[k]);
+				int *w = polygon.ptrw();
+				for (int l = 0; l < rp[k]; l++) {
+					w[flip ? rp[k] - 1 - l : l] = vofs + rp[k + 1 + l];
+				}
+				jl.result_polygons.push_back(polygon);
+			}
+			vofs += vc;
+		}
+		jl.vertices.clear();
+		jl.polygons.clear();
+		jl.transforms.clear();
+	}
+}
+
+void TileMap3D::OctantNavigationJob::apply(TileMap3D *p_tilemap, Octant *p_oct) {
+	p_oct->navigation_version = 0;
+	NavigationServer3D *ns = NavigationServer3D::get_singleton();
+
+	// Regions of layers the octant no longer has go away.
+	for (int i = p_oct->navigation.size() - 1; i >= 0; i--) {
+		bool found = false;
+		for (uint32_t j = 0; j < navigation_layers.size() && !found; j++) {
+			found = navigation_layers[j].layer_id == p_oct->navigation[i].layer_id;
+		}
+		if (!found) {
+			ns->free(p_oct->navigation[i].region);
+			p_oct->navigation.remove_at(i);
+		}
+	}
+
+	for (uint32_t i = 0; i < navigation_layers.size(); i++) {
+		const NavigationLayer &jl = navigation_layers[i];
+		Octant::OctantNavigationLayer *nl = nullptr;
+		for (uint32_t j = 0; j < p_oct->navigation.size(); j++) {
+			if (p_oct->navigation[j].layer_id == jl.layer_id) {
+				nl = &p_oct->navigation[j];
+				break;
+			}
+		}
+		if (!nl) {
+			Octant::OctantNavigationLayer layer;
+			layer.layer_id = jl.layer_id;
+			layer.region = ns->region_create();
+			ns->region_set_layers(layer.region, 1 << jl.layer_id);
+			if (p_tilemap->is_inside_world()) {
+				ns->region_set_transform(layer.region, p_tilemap->get_global_transform());
+				ns->region_set_map(layer.region, p_tilemap->get_world_3d()->get_navigation_map());
+			}
+			p_oct->navigation.push_back(layer);
+			nl = &p_oct->navigation[p_oct->navigation.size() - 1];
+		}
+
+		// A new navigation mesh is swapped in, the server keeps using the
+		// previous one until then.
+		Ref<NavigationMesh> navmesh;
+		navmesh.instantiate();
+		navmesh->set_vertices(jl.result_vertices);
+		for (int j = 0; j < jl.result_polygons.size(); j++) {
+			navmesh->add_polygon(jl.result_polygons[j]);
+		}
+		nl->navmesh = navmesh;
+		ns->region_set_navmesh(nl->region, navmesh);
+	}
+}
+
+void TileMap3D::_multimesh_set_visible(const Octant::MultimeshInstance &p_mmi, bool p_visible) {
+	RS::get_singleton()->instance_set_visible(p_mmi.instance, p_visible);
+	if (p_mmi.shadow_instance.is_valid()) {
+		RS::get_singleton()->instance_set_visible(p_mmi.shadow_instance, p_visible);
+	}
+}
+
+void TileMap3D::_multimesh_set_instance_transform(const Octant::MultimeshInstance &p_mmi, int p_slot, const Transform3D &p_transform) {
+	RS::get_singleton()->multimesh_instance_set_transform(p_mmi.multimesh, p_slot, p_transform);
+	if (p_mmi.shadow_multimesh.is_valid()) {
+		RS::get_singleton()->multimesh_instance_set_transform(p_mmi.shadow_multimesh, p_slot, p_transform);
+	}
+}
+
+void TileMap3D::_multimesh_set_visible_instances(const Octant::MultimeshInstance &p_mmi, int p_count) {
+	RS::get_singleton()->multimesh_set_visible_instances(p_mmi.multimesh, p_count);
+	if (p_mmi.shadow_multimesh.is_valid()) {
+		RS::get_singleton()->multimesh_set_visible_instances(p_mmi.shadow_multimesh, p_count);
+	}
+}
+
+void TileMap3D::_apply_render_settings(RID p_instance, const TileCache &p_cache, int p_layer) {
+	// Every setting is written, pooled instances keep those of their last
+	// tile.
+	RenderingServer *rs = RenderingServer::get_singleton();
+	const Ref<TileData3DMesh> &data = p_cache.data;
+	_apply_layer_render_settings(p_instance, &p_cache, p_layer);
+	rs->instance_geometry_set_cast_shadows_setting(p_instance, RS::ShadowCastingSetting(data->get_cast_shadow_mode()));
+	rs->instance_geometry_set_lod_bias(p_instance, data->get_lod_bias());
+	rs->instance_geometry_set_flag(p_instance, RS::INSTANCE_FLAG_IGNORE_OCCLUSION_CULLING, data->is_ignoring_occlusion_culling());
+	rs->instance_geometry_set_flag(p_instance, RS::INSTANCE_FLAG_USE_BAKED_LIGHT, data->get_gi_mode() == GeometryInstance3D::GI_MODE_BAKED);
+	rs->instance_geometry_set_flag(p_instance, RS::INSTANCE_FLAG_USE_DYNAMIC_GI, data->get_gi_mode() == GeometryInstance3D::GI_MODE_DYNAMIC);
+	rs->instance_geometry_set_visibility_range(p_instance,
+			data->get_visibility_range_begin(), data->get_visibility_range_end(),
+			data->get_visibility_range_begin_margin(), data->get_visibility_range_end_margin(),
+			RS::VisibilityRangeFadeMode(data->get_visibility_range_fade_mode()));
+}
+
+void TileMap3D::_apply_layer_render_settings(RID p_instance, const TileCache *p_cache, int p_layer) {
+	// Settings shared by the tile and its layer. The layer material wins,
+	// transparencies stack.
+	RenderingServer *rs = RenderingServer::get_singleton();
+	const TileMapLayer &layer = layers[p_layer];
+	Ref<Material> material_override = layer.material_override;
+	float transparency = layer.transparency;
+	if (p_cache && p_cache->data.is_valid()) {
+		if (material_override.is_null()) {
+			material_override = p_cache->data->get_material_override();
+		}
+		transparency = 1.0 - (1.0 - transparency) * (1.0 - p_cache->data->get_transparency());
+	}
+	rs->instance_geometry_set_material_override(p_instance, material_override.is_valid() ? material_override->get_rid() : RID());
+	rs->instance_geometry_set_transparency(p_instance, transparency);
+	rs->instance_set_layer_mask(p_instance, layer.render_layers);
+}
+
+void TileMap3D::_update_layer_render_state(int p_layer) {
+	// Multimeshes and baked meshes never mix layers, so only their instance
+	// state has to change.
+	RenderingServer *rs = RenderingServer::get_singleton();
+	for (KeyValue<OctantKey, Octant *> &E : octant_map) {
+		Octant *oct = E.value;
+		bool baked = !oct->baked_meshes.is_empty();
+		for (int i = 0; i < oct->multimesh_instances.size(); i++) {
+			const Octant::MultimeshInstance &mmi = oct->multimesh_instances[i];
+			if (mmi.tile.layer != p_layer) {
+				continue;
+			}
+			const TileCache *cache = _get_tile_cache(mmi.tile);
+			_apply_layer_render_settings(mmi.instance, cache, p_layer);
+			if (mmi.shadow_instance.is_valid()) {
+				_apply_layer_render_settings(mmi.shadow_instance, cache, p_layer);
+			}
+			if (is_inside_tree()) {
+				_multimesh_set_visible(mmi, _is_layer_visible(p_layer) && !baked);
+			}
+		}
+		for (uint32_t i = 0; i < oct->baked_meshes.size(); i++) {
+			const Octant::BakedMesh &bm = oct->baked_meshes[i];
+			if (bm.layer != p_layer) {
+				continue;
+			}
+			_apply_layer_render_settings(bm.instance, nullptr, p_layer);
+			if (is_inside_tree()) {
+				rs->instance_set_visible(bm.instance, _is_layer_visible(p_layer));
+			}
+		}
+	}
+}
+
+void TileMap3D::_octant_prepare_occluder_thread(uint32_t p_index, Octant **p_octants) {
+	_octant_prepare_occluder(p_octants[p_index]);
+}
+
+void TileMap3D::_octant_prepare_occluder(Octant *p_oct) const {
+	// Runs on worker threads, like _octant_prepare().
+	p_oct->occluder_vertices.clear();
+	p_oct->occluder_indices.clear();
+	LocalVector<Vector3i> opaque_cells;
+
+	const CellChunk *chunk = nullptr;
+	int chunk_layer = -1;
+	for (Set<MapCell>::Element *E = p_oct->cells.front(); E; E = E->next()) {
+		const MapCell &cell = E->get();
+		ERR_CONTINUE(cell.layer < 0 || cell.layer >= layers.size());
+
+		if (cell.layer != chunk_layer) {
+			chunk = nullptr;
+			chunk_layer = cell.layer;
+		}
+		int ci = layers[cell.layer].cells->find(cell, chunk);
+		ERR_CONTINUE(ci < 0);
+		if (!layers[cell.layer].enabled) {
+			continue;
+		}
+
+		if (occlusion_generate_boxes && (chunk->flags[ci] & CELL_FLAG_OPAQUE)) {
+			opaque_cells.push_back(cell);
+		}
+
+		MapTile mt;
+		mt.tile = chunk->tiles[ci];
+		mt.rot_idx = chunk->rotations[ci];
+		const TileCache *cache = _get_tile_cache(mt.tile);
+		if (!cache || cache->occlusion_indices.is_empty()) {
+			continue;
+		}
+		if (_is_culling_hidden_cells() && _is_cell_hidden(cell)) {
+			continue;
+		}
+
+		Transform3D transform = _get_cell_transform(cell, mt, *cache);
+		int vertex_base = p_oct->occluder_vertices.size();
+		int vertex_count = cache->occlusion_vertices.size();
+		p_oct->occluder_vertices.resize(vertex_base + vertex_count);
+		Vector3 *wv = p_oct->occluder_vertices.ptrw() + vertex_base;
+		const Vector3 *rv = cache->occlusion_vertices.ptr();
+		for (int i = 0; i < vertex_count; i++) {
+			wv[i] = transform.xform(rv[i]);
+		}
+
+		int index_base = p_oct->occluder_indices.size();
+		int index_count = cache->occlusion_indices.size();
+		p_oct->occluder_indices.resize(index_base + index_count);
+		int *wi = p_oct->occluder_indices.ptrw() + index_base;
+		const int *ri = cache->occlusion_indices.ptr();
+		for (int i = 0; i < index_count; i++) {
+			wi[i] = ri[i] + vertex_base;
+		}
+	}
+
+	if (!opaque_cells.is_empty()) {
+		// Hexagonal prisms only stack along the main axis into a box.
+		int grow_axes = cells_are_cuboid ? 0x7 : 1 << (3 - cell_plane_axes[0] - cell_plane_axes[1]);
+		LocalVector<CellBox> boxes;
+		_merge_cell_boxes(opaque_cells, boxes, grow_axes);
+		for (uint32_t i = 0; i < boxes.size(); i++) {
+			_append_box_occluder(boxes[i], p_oct->occluder_vertices, p_oct->occluder_indices);
+		}
+	}
+}
+
+void TileMap3D::_merge_cell_boxes(const LocalVector<Vector3i> &p_cells, LocalVector<CellBox> &r_boxes, int p_grow_axes, int p_first_axis) {
+	r_boxes.clear();
+	if (p_cells.is_empty()) {
+		return;
+	}
+
+	Vector3i from = p_cells[0];
+	Vector3i to = p_cells[0];
+	for (uint32_t i = 1; i < p_cells.size(); i++) {
+		const Vector3i &c = p_cells[i];
+		from = Vector3i(MIN(from.x, c.x), MIN(from.y, c.y), MIN(from.z, c.z));
+		to = Vector3i(MAX(to.x, c.x), MAX(to.y, c.y), MAX(to.z, c.z));
+	}
+
+	// Dense occupancy of the bounding block. Cells are cleared once they
+	// belong to a box.
+	Vector3i size = to - from + Vector3i(1, 1, 1);
+	LocalVector<uint8_t> grid;
+	grid.resize(size.x * size.y * size.z);
+	memset(grid.ptr(), 0, grid.size());
+	for (uint32_t i = 0; i < p_cells.size(); i++) {
+		Vector3i c = p_cells[i] - from;
+		grid[(c.z * size.y + c.y) * size.x + c.x] = 1;
+	}
+
+	auto is_filled = [&](const Vector3i &p_from, const Vector3i &p_to) {
+		for (int z = p_from.z; z < p_to.z; z++) {
+			for (int y = p_from.y; y < p_to.y; y++) {
+				const uint8_t *row = grid.ptr() + (z * size.y + y) * size.x;
+				for (int x = p_from.x; x < p_to.x; x++) {
+					if (!row[x]) {
+						return false;
+					}
+				}
+			}
+		}
+		return true;
+	};
+
+	for (int z = 0; z < size.z; z++) {
+		for (int y = 0; y < size.y; y++) {
+			for (int x = 0; x < size.x; x++) {
+				if (!grid[(z * size.y + y) * size.x + x]) {
+					continue;
+				}
+
+				Vector3i begin(x, y, z);
+				Vector3i end(x + 1, y + 1, z + 1);
+				for (int i = 0; i < 3; i++) {
+					int axis = (p_first_axis + i) % 3;
+					if (!(p_grow_axes & (1 << axis))) {
+						continue;
+					}
+					// Grow one slab at a time while the whole slab is filled.
+					Vector3i slab_begin = begin;
+					Vector3i slab_end = end;
+					while (end[axis] < size[axis]) {
+						slab_begin[axis] = end[axis];
+						slab_end[axis] = end[axis] + 1;
+						if (!is_filled(slab_begin, slab_end)) {
+							break;
+						}
+						end[axis]++;
+					}
+				}
+
+				for (int bz = z; bz < end.z; bz++) {
+					for (int by = y; by < end.y; by++) {
+						memset(grid.ptr() + (bz * size.y + by) * size.x + x, 0, end.x - x);
+					}
+				}
+
+				CellBox box;
+				box.position = from + begin;
+				box.size = end - begin;
+				r_boxes.push_back(box);
+			}
+		}
+	}
+}
+
+void TileMap3D::_append_box_occluder(const CellBox &p_box, PackedVector3Array &r_vertices, PackedInt32Array &r_indices) const {
+	Vector3 half_size = Vector3(p_box.size) * 0.5;
+	Vector3 center = cell_to_local(p_box.position) + cell_basis[0] * (half_size.x - 0.5) + cell_basis[1] * (half_size.y - 0.5) + cell_basis[2] * (half_size.z - 0.5);
+	Vector3 extents[3];
+	if (cells_are_cuboid) {
+		for (int i = 0; i < 3; i++) {
+			extents[i] = cell_basis[i] * half_size[i];
+		}
+	} else {
+		// Conservative: the box has to stay inside every prism of the column.
+		int axis0 = 3 - cell_plane_axes[0] - cell_plane_axes[1];
+		extents[axis0] = cell_basis[axis0] * half_size[axis0];
+		for (int i = 0; i < 2; i++) {
+			int axis = cell_plane_axes[i];
+			extents[axis] = Vector3();
+			extents[axis][axis] = hex_inner_half_extents[axis];
+		}
+	}
+
+	int vertex_base = r_vertices.size();
+	r_vertices.resize(vertex_base + 8);
+	Vector3 *wv = r_vertices.ptrw() + vertex_base;
+	for (int i = 0; i < 8; i++) {
+		wv[i] = center + (i & 1 ? extents[0] : -extents[0]) + (i & 2 ? extents[1] : -extents[1]) + (i & 4 ? extents[2] : -extents[2]);
+	}
+
+	int index_base = r_indices.size();
+	r_indices.resize(index_base + 36);
+	int *wi = r_indices.ptrw() + index_base;
+	for (int i = 0; i < 36; i++) {
+		wi[i] = box_indices[i] + vertex_base;
+	}
+}
+
+void TileMap3D::_octant_commit_occluder(Octant *p_oct) {
+	p_oct->occluder_dirty = false;
+	if (p_oct->occluder_indices.is_empty()) {
+		_octant_free_occluder(p_oct);
+		return;
+	}
+
+	RenderingServer *rs = RenderingServer::get_singleton();
+	if (!p_oct->occluder.is_valid()) {
+		p_oct->occluder = rs->occluder_create();
+		p_oct->occluder_instance = rs->instance_create();
+		rs->instance_set_base(p_oct->occluder_instance, p_oct->occluder);
+		if (is_inside_world()) {
+			rs->instance_set_scenario(p_oct->occluder_instance, get_world_3d()->get_scenario());
+			rs->instance_set_transform(p_oct->occluder_instance, get_global_transform());
+		}
+		if (is_inside_tree()) {
+			rs->instance_set_visible(p_oct->occluder_instance, is_visible_in_tree());
+		}
+	}
+	rs->occluder_set_mesh(p_oct->occluder, p_oct->occluder_vertices, p_oct->occluder_indices);
+	p_oct->occluder_vertices.clear();
+	p_oct->occluder_indices.clear();
+}
+
+void TileMap3D::_octant_free_occluder(Octant *p_oct) {
+	if (!p_oct->occluder.is_valid()) {
+		return;
+	}
+	RS::get_singleton()->free(p_oct->occluder_instance);
+	RS::get_singleton()->free(p_oct->occluder);
+	p_oct->occluder_instance = RID();
+	p_oct->occluder = RID();
+}
+
+bool TileMap3D::_octant_patch(Octant *p_oct) {
+	if (p_oct->cells.size() == 0) {
+		return false;
+	}
+
+	for (Set<MapCell>::Element *E = p_oct->dirty_cells.front(); E; E = E->next()) {
+		const MapCell &cell = E->get();
+
+		MapTile mt;
+		const TileCache *cache = _get_cell_data(cell, mt);
+		bool has_mesh = cache && cache->mesh.is_valid();
+		if (has_mesh && _is_culling_hidden_cells() && _is_cell_hidden(cell)) {
+			has_mesh = false;
+		}
+		bool occludes = cache && (!cache->occlusion_indices.is_empty() || (occlusion_generate_boxes && (cache->cell_flags & CELL_FLAG_OPAQUE)));
+		if (p_oct->occluder.is_valid() || occludes) {
+			// The previous tile of the cell is unknown here, so any change
+			// in an octant with an occluder refreshes it.
+			p_oct->occluder_dirty = true;
+		}
+
+		int mmi_idx = -1;
+		int slot = -1;
+		Map<MapCell, RID>::Element *I = multimeshes.find(cell);
+		if (I) {
+			for (int i = 0; i < p_oct->multimesh_instances.size(); i++) {
+				if (p_oct->multimesh_instances[i].instance == I->get()) {
+					mmi_idx = i;
+					break;
+				}
+			}
+			ERR_FAIL_COND_V(mmi_idx < 0, false);
+			slot = instance_indices[cell];
+		}
+
+		if (mmi_idx >= 0 && has_mesh && p_oct->multimesh_instances[mmi_idx].tile == mt.tile) {
+			// Same tile, only the transform may have changed.
+			Transform3D transform = _get_cell_transform(cell, mt, *cache);
+			_multimesh_set_instance_transform(p_oct->multimesh_instances[mmi_idx], slot, transform);
+			_octant_grow_aabb(p_oct, mmi_idx, _get_instance_aabb(mt, *cache, transform));
+			continue;
+		}
+
+		if (mmi_idx >= 0) {
+			_octant_remove_instance(p_oct, mmi_idx, slot);
+		}
+
+		if (!has_mesh) {
+			continue;
+		}
+
+		int target = _octant_find_multimesh(p_oct, mt.tile);
+		if (target < 0 || (int)p_oct->multimesh_instances[target].cells.size() >= p_oct->multimesh_instances[target].capacity) {
+			// New tile in this octant or no room left, rebuild.
+			return false;
+		}
+
+		Octant::MultimeshInstance &mmi = p_oct->multimesh_instances[target];
+		int new_slot = mmi.cells.size();
+		mmi.cells.push_back(cell);
+		Transform3D transform = _get_cell_transform(cell, mt, *cache);
+		_multimesh_set_instance_transform(mmi, new_slot, transform);
+		_multimesh_set_visible_instances(mmi, mmi.cells.size());
+		multimeshes[cell] = mmi.instance;
+		instance_indices[cell] = new_slot;
+		_octant_grow_aabb(p_oct, target, _get_instance_aabb(mt, *cache, transform));
+	}
+
+	return true;
+}
+
+void TileMap3D::_octant_grow_aabb(Octant *p_oct, int p_mmi, const AABB &p_aabb) {
+	// Bounds only grow while patching, the next full rebuild shrinks them.
+	Octant::MultimeshInstance &mmi = p_oct->multimesh_instances[p_mmi];
+	if (mmi.aabb.encloses(p_aabb)) {
+		return;
+	}
+	mmi.aabb.merge_with(p_aabb);
+	p_oct->aabb.merge_with(mmi.aabb);
+	RS::get_singleton()->instance_set_custom_aabb(mmi.instance, mmi.aabb);
+}
+
+AABB TileMap3D::_get_instance_aabb(const MapTile &p_tile, const TileCache &p_cache, const Transform3D &p_transform) const {
+	if (p_tile.is_orthogonal()) {
+		AABB aabb = p_cache.rotated_aabbs[p_tile.rot_idx];
+		aabb.position += p_transform.origin;
+		return aabb;
+	}
+	return p_transform.xform(p_cache.mesh_aabb);
+}
+
+void TileMap3D::_octant_remove_instance(Octant *p_oct, int p_mmi, int p_slot) {
+	Octant::MultimeshInstance &mmi = p_oct->multimesh_instances[p_mmi];
+	ERR_FAIL_INDEX(p_slot, (int)mmi.cells.size());
+
+	MapCell removed = mmi.cells[p_slot];
+	int last = mmi.cells.size() - 1;
+	if (p_slot != last) {
+		// Move the last instance into the freed slot.
+		MapCell moved = mmi.cells[last];
+		MapTile mt;
+		const TileCache *cache = _get_cell_data(moved, mt);
+		if (cache) {
+			_multimesh_set_instance_transform(mmi, p_slot, _get_cell_transform(moved, mt, *cache));
+		}
+		mmi.cells[p_slot] = moved;
+		instance_indices[moved] = p_slot;
+	}
+	mmi.cells.resize(last);
+	_multimesh_set_visible_instances(mmi, last);
+
+	multimeshes.erase(removed);
+	instance_indices.erase(removed);
+}
+
+int TileMap3D::_octant_find_multimesh(const Octant *p_oct, const MapTile::Tile &p_tile) const {
+	for (int i = 0; i < p_oct->multimesh_instances.size(); i++) {
+		if (p_oct->multimesh_instances[i].tile == p_tile) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+const TileMap3D::TileCache *TileMap3D::_get_cell_data(const MapCell &p_cell, MapTile &r_tile) const {
+	if (p_cell.layer < 0 || p_cell.layer >= layers.size()) {
+		return nullptr;
+	}
+	if (!layers[p_cell.layer].cells->get(p_cell, r_tile)) {
+		return nullptr;
+	}
+	r_tile.tile.layer = p_cell.layer;
+	return _get_tile_cache(r_tile.tile);
+}
+
+const TileMap3D::TileCache *TileMap3D::_get_tile_cache(const MapTile::Tile &p_tile) const {
+	const Map<MapTile::Tile, TileCache *>::Element *E = tile_cache.find(_get_tile_cache_key(p_tile));
+	if (!E || E->get()->data.is_null()) {
+		return nullptr;
+	}
+	return E->get();
+}
+
+void TileMap3D::_cache_tile(const MapTile::Tile &p_tile) {
+	MapTile::Tile key = _get_tile_cache_key(p_tile);
+	if (tile_cache.has(key)) {
+		return;
+	}
+	TileCache *cache = memnew(TileCache);
+	_update_tile_cache_entry(key, cache);
+	tile_cache.insert(key, cache);
+}
+
+void TileMap3D::_update_tile_cache_entry(const MapTile::Tile &p_key, TileCache *p_cache) {
+	p_cache->data = Ref<TileData3DMesh>();
+	p_cache->mesh = RID();
+	p_cache->shadow_mesh = RID();
+	p_cache->mesh_transform = Transform3D();
+	p_cache->mesh_aabb = AABB();
+	p_cache->cell_flags = 0;
+	p_cache->walk_cost = 1.0;
+	p_cache->occlusion_vertices = PackedVector3Array();
+	p_cache->occlusion_indices = PackedInt32Array();
+	p_cache->surface_arrays.clear();
+	p_cache->surface_materials.clear();
+	p_cache->collision_faces.clear();
+	p_cache->navigation_vertices.clear();
+	p_cache->navigation_polygons.clear();
+	if (tile_set.is_null()) {
+		return;
+	}
+
+	Ref<TileData3DMesh> data = tile_set->get_collection_tile(p_key.collection_id, p_key.tile_id, p_key.alternative_id);
+	if (data.is_null()) {
+		return;
+	}
+	p_cache->data = data;
+	p_cache->mesh_transform = data->get_mesh_transform();
+	p_cache->cell_flags = (data->is_opaque_full_cell() ? CELL_FLAG_OPAQUE : 0) | (data->is_walkable() ? CELL_FLAG_WALKABLE : 0);
+	p_cache->walk_cost = data->get_walk_cost();
+	if (data->get_occlusion_indices().size() >= 3) {
+		p_cache->occlusion_vertices = data->get_occlusion_vertices();
+		p_cache->occlusion_indices = data->get_occlusion_indices();
+	}
+	if (data->get_mesh().is_valid()) {
+		p_cache->mesh = data->get_mesh()->get_rid();
+		p_cache->mesh_aabb = data->get_mesh()->get_aabb();
+	}
+	if (data->get_shadow_mesh().is_valid() && data->get_cast_shadow_mode() != GeometryInstance3D::SHADOW_CASTING_SETTING_OFF) {
+		p_cache->shadow_mesh = data->get_shadow_mesh()->get_rid();
+	}
+
+	for (int i = 0; i < MapTile::ORTHOGONAL_ROT_COUNT; i++) {
+		Transform3D rotation = Transform3D(_get_orthogonal_basis(i), Vector3());
+		rotation.basis.scale(Vector3(cell_scale, cell_scale, cell_scale));
+		p_cache->rotated_transforms[i] = rotation * p_cache->mesh_transform;
+		p_cache->rotated_aabbs[i] = Transform3D(p_cache->rotated_transforms[i].basis, Vector3()).xform(p_cache->mesh_aabb);
+	}
+}
+
+void TileMap3D::_add_tile_cell_count(const MapTile::Tile &p_tile, int p_count) {
+	Map<MapTile::Tile, TileCache *>::Element *E = tile_cache.find(_get_tile_cache_key(p_tile));
+	if (E) {
+		E->get()->cell_count += p_count;
+	}
+}
+
+void TileMap3D::_refresh_tile_cache() {
+	for (KeyValue<MapTile::Tile, TileCache *> &E : tile_cache) {
+		_update_tile_cache_entry(E.key, E.value);
+	}
+}
+
+void TileMap3D::_clear_tile_cache() {
+	for (KeyValue<MapTile::Tile, TileCache *> &E : tile_cache) {
+		memdelete(E.value);
+	}
+	tile_cache.clear();
+}
+
+void TileMap3D::_write_instance_transform(float *p_ptr, const Transform3D &p_transform) {
+	// Same layout as RS::MULTIMESH_TRANSFORM_3D: basis rows with the origin
+	// component appended to each.
+	const Basis &b = p_transform.basis;
+	p_ptr[0] = b[0][0];
+	p_ptr[1] = b[0][1];
+	p_ptr[2] = b[0][2];
+	p_ptr[3] = p_transform.origin.x;
+	p_ptr[4] = b[1][0];
+	p_ptr[5] = b[1][1];
+	p_ptr[6] = b[1][2];
+	p_ptr[7] = p_transform.origin.y;
+	p_ptr[8] = b[2][0];
+	p_ptr[9] = b[2][1];
+	p_ptr[10] = b[2][2];
+	p_ptr[11] = p_transform.origin.z;
+}
+
+Transform3D TileMap3D::_get_cell_transform(const MapCell &p_cell, const MapTile &p_tile, const TileCache &p_cache) const {
+	return _get_cell_transform(p_cell, p_tile, p_cache, cell_to_local(p_cell));
+}
+
+Transform3D TileMap3D::_get_cell_transform(const MapCell &p_cell, const MapTile &p_tile, const TileCache &p_cache, const Vector3 &p_origin) const {
+	if (p_tile.is_orthogonal()) {
+		Transform3D transform = p_cache.rotated_transforms[p_tile.rot_idx];
+		transform.origin += p_origin;
+		return transform;
+	}
+
+	Transform3D transform = Transform3D(layers[p_cell.layer].cells->get_rotation(p_cell, p_tile.rot_idx), p_origin);
+	transform.basis.scale(Vector3(cell_scale, cell_scale, cell_scale));
+	return transform * p_cache.mesh_transform;
+}
+
+Transform3D TileMap3D::_get_cell_base_transform(const MapCell &p_cell, const MapTile &p_tile) const {
+	Transform3D transform = Transform3D(layers[p_cell.layer].cells->get_rotation(p_cell, p_tile.rot_idx), cell_to_local(p_cell));
+	transform.basis.scale(Vector3(cell_scale, cell_scale, cell_scale));
+	return transform;
+}
+
+void TileMap3D::_insert_octant_cell(const OctantKey &p_ok, const MapCell &p_cell) {
+	Map<OctantKey, Octant *>::Element *O = octant_map.find(p_ok);
+	if (!O) {
+		Octant *oct = memnew(Octant);
+
+		O = octant_map.insert(p_ok, oct);
+	}
+
+	Octant &oct = *O->get();
+	oct.cells.insert(p_cell);
+	if (oct.multimesh_instances.is_empty()) {
+		oct.dirty = true;
+	} else {
+		oct.dirty_cells.insert(p_cell);
+	}
+	_queue_octant(p_ok, &oct);
+}
+
+void TileMap3D::_mark_cell_dirty(const MapCell &p_cell) {
+	OctantKey ok = _cell_to_octant(p_cell);
+	Map<OctantKey, Octant *>::Element *O = octant_map.find(ok);
+	ERR_FAIL_NULL(O);
+	O->get()->dirty_cells.insert(p_cell);
+	_queue_octant(ok, O->get());
+}
+
+void TileMap3D::_queue_octant(const OctantKey &p_key, Octant *p_oct) {
+	if (!p_oct->queued) {
+		p_oct->queued = true;
+		dirty_octants.push_back(p_key);
+	}
+	_queue_octants_dirty();
+}
+
+void TileMap3D::_mark_octants_as_dirty() {
+	for (KeyValue<OctantKey, Octant *> &E : octant_map) {
+		E.value->dirty = true;
+		_queue_octant(E.key, E.value);
+	}
+	_queue_octants_dirty();
+}
+
+void TileMap3D::_tileset_changed() {
+	_refresh_tile_cache();
+	_update_cell_flags();
+	_mark_octants_as_dirty();
+	_update_cell_vectors();
+	_recreate_light_cells();
+}
+
+bool TileMap3D::_is_cell_opaque(const Vector3i &p_cell) const {
+	for (int i = 0; i < layers.size(); i++) {
+		if (layers[i].enabled && (layers[i].cells->get_flags(p_cell) & CELL_FLAG_OPAQUE)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool TileMap3D::_is_cell_hidden(const Vector3i &p_cell) const {
+	// Only the six face neighbors can hide a cuboid cell.
+	return _is_cell_opaque(p_cell + Vector3i(1, 0, 0)) && _is_cell_opaque(p_cell + Vector3i(-1, 0, 0)) &&
+			_is_cell_opaque(p_cell + Vector3i(0, 1, 0)) && _is_cell_opaque(p_cell + Vector3i(0, -1, 0)) &&
+			_is_cell_opaque(p_cell + Vector3i(0, 0, 1)) && _is_cell_opaque(p_cell + Vector3i(0, 0, -1));
+}
+
+void TileMap3D::_mark_neighbors_dirty(const Vector3i &p_cell) {
+	// Neighbors may be in other octants, which get queued as well.
+	static const Vector3i offsets[6] = { Vector3i(1, 0, 0), Vector3i(-1, 0, 0), Vector3i(0, 1, 0), Vector3i(0, -1, 0), Vector3i(0, 0, 1), Vector3i(0, 0, -1) };
+	for (int i = 0; i < 6; i++) {
+		Vector3i n = p_cell + offsets[i];
+		for (int j = 0; j < layers.size(); j++) {
+			MapTile mt;
+			if (layers[j].cells->get(n, mt)) {
+				_mark_cell_dirty(MapCell(n, j));
+			}
+		}
+	}
+}
+
+void TileMap3D::_update_cell_flags() {
+	path_graph.clear();
+	for (int i = 0; i < layers.size(); i++) {
+		CellStorage &storage = *layers[i].cells;
+		for (int j = 0; j < storage.get_chunk_count(); j++) {
+			CellChunk *chunk = storage.get_chunk_by_index(j);
+			for (int k = chunk->next_used(0); k >= 0; k = chunk->next_used(k + 1)) {
+				const TileCache *cache = _get_tile_cache(chunk->tiles[k]);
+				chunk->flags[k] = cache ? cache->cell_flags : 0;
+			}
+		}
+	}
+}
+
+void TileMap3D::_update_cell_lights(const MapCell &p_cell) {
+	Map<MapCell, LocalVector<Transform3D>>::Element *L = light_cells.find(p_cell);
+	if (L) {
+		for (uint32_t i = 0; i < L->get().size(); i++) {
+			LightKey key;
+			key.cell = p_cell;
+			key.index = i;
+			Map<LightKey, ActiveLight>::Element *A = active_lights.find(key);
+			if (A) {
+				_release_light(A->get());
+				active_lights.erase(A);
+			}
+		}
+		light_cells.erase(L);
+		lights_dirty = true;
+	}
+
+	MapTile mt;
+	const TileCache *cache = _get_cell_data(p_cell, mt);
+	if (cache && cache->data->get_light_count() > 0) {
+		Transform3D cell_transform = _get_cell_base_transform(p_cell, mt);
+		LocalVector<Transform3D> transforms;
+		for (int i = 0; i < cache->data->get_light_count(); i++) {
+			transforms.push_back(cell_transform * cache->data->get_light(i).local_transform);
+		}
+		light_cells.insert(p_cell, transforms);
+		lights_dirty = true;
+	}
+	_update_internal_processing();
+}
+
+void TileMap3D::_recreate_light_cells() {
+	_release_active_lights();
+	light_cells.clear();
+	for (int i = 0; i < layers.size(); i++) {
+		const CellStorage &storage = *layers[i].cells;
+		for (int j = 0; j < storage.get_chunk_count(); j++) {
+			const CellChunk *chunk = storage.get_chunk_by_index(j);
+			for (int k = chunk->next_used(0); k >= 0; k = chunk->next_used(k + 1)) {
+				const TileCache *cache = _get_tile_cache(chunk->tiles[k]);
+				if (cache && cache->data->get_light_count() > 0) {
+					_update_cell_lights(MapCell(chunk->get_cell(k), i));
+				}
+			}
+		}
+	}
+	lights_dirty = true;
+	_update_internal_processing();
+}
+
+void TileMap3D::_update_lights() {
+	if (!is_inside_world()) {
+		return;
+	}
+
+	Vector3 origin;
+	Camera3D *camera = get_viewport()->get_camera_3d();
+	if (camera) {
+		origin = get_global_transform().affine_inverse().xform(camera->get_global_transform().origin);
+	}
+	// Small camera moves keep the current selection, a static camera does
+	// not sort the lights every frame.
+	if (!lights_dirty && origin.distance_squared_to(last_light_origin) < light_update_distance * light_update_distance) {
+		return;
+	}
+	lights_dirty = false;
+	last_light_origin = origin;
+
+	LocalVector<LightCandidate> candidates;
+	for (const KeyValue<MapCell, LocalVector<Transform3D>> &E : light_cells) {
+		if (!layers[E.key.layer].enabled) {
+			continue;
+		}
+		for (uint32_t i = 0; i < E.value.size(); i++) {
+			LightCandidate candidate;
+			candidate.key.cell = E.key;
+			candidate.key.index = i;
+			candidate.distance = E.value[i].origin.distance_to(origin);
+			candidates.push_back(candidate);
+		}
+	}
+	candidates.sort();
+
+	int count = MIN(max_active_lights, (int)candidates.size());
+	real_t cutoff = count < (int)candidates.size() ? candidates[count].distance : Math_INF;
+
+	// Lights that are no longer among the nearest go back to the pool first,
+	// so the new ones can reuse them.
+	Set<LightKey> selected;
+	for (int i = 0; i < count; i++) {
+		selected.insert(candidates[i].key);
+	}
+	Map<LightKey, ActiveLight>::Element *E = active_lights.front();
+	while (E) {
+		Map<LightKey, ActiveLight>::Element *N = E->next();
+		if (!selected.has(E->key())) {
+			_release_light(E->get());
+			active_lights.erase(E);
+		}
+		E = N;
+	}
+
+	RenderingServer *rs = RenderingServer::get_singleton();
+	for (int i = 0; i < count; i++) {
+		const LightCandidate &candidate = candidates[i];
+		Map<LightKey, ActiveLight>::Element *A = active_lights.find(candidate.key);
+		if (!A) {
+			MapTile mt;
+			const TileCache *cache = _get_cell_data(candidate.key.cell, mt);
+			ERR_CONTINUE(!cache || candidate.key.index >= cache->data->get_light_count());
+			const TileData3DMesh::LightTileData3D &data = cache->data->get_light(candidate.key.index);
+			A = active_lights.insert(candidate.key, _acquire_light(data.type));
+			A->get().transform = light_cells[candidate.key.cell][candidate.key.index];
+			_configure_light(A->get(), data);
 		}
 
-		if (is_inside_tree()) {
-			rs->instance_set_scenario(instance, get_world_3d()->get_scenario());
-			rs->instance_set_transform(instance, get_global_transform());
+		float fade = 1.0;
+		if (light_fade_margin > 0.0 && cutoff != Math_INF) {
+			fade = CLAMP((cutoff - candidate.distance) / light_fade_margin, 0.0, 1.0);
+		}
+		// Small steps are skipped, but both ends of the fade are always set.
+		ActiveLight &al = A->get();
+		if (Math::abs(fade - al.fade) > 0.01 || (fade != al.fade && (fade == 0.0 || fade == 1.0))) {
+			al.fade = fade;
+			rs->light_set_param(al.light, RS::LIGHT_PARAM_ENERGY, al.energy * fade);
 		}
+	}
+}
 
-		mmi.multimesh = mm;
-		mmi.instance = instance;
-		p_oct->multimesh_instances.push_back(mmi);
+TileMap3D::ActiveLight TileMap3D::_acquire_light(TileData3DMesh::LightType p_type) {
+	for (uint32_t i = 0; i < light_pool.size(); i++) {
+		if (light_pool[i].type == p_type) {
+			ActiveLight al = light_pool[i];
+			light_pool.remove_at_unordered(i);
+			return al;
+		}
 	}
 
-	return false;
+	RenderingServer *rs = RenderingServer::get_singleton();
+	ActiveLight al;
+	al.type = p_type;
+	al.light = p_type == TileData3DMesh::LIGHT_TYPE_SPOT ? rs->spot_light_create() : rs->omni_light_create();
+	al.instance = rs->instance_create();
+	rs->instance_set_base(al.instance, al.light);
+	if (is_inside_world()) {
+		rs->instance_set_scenario(al.instance, get_world_3d()->get_scenario());
+	}
+	return al;
 }
 
-void TileMap3D::_insert_octant_cell(const OctantKey &p_ok, const MapCell &p_cell) {
-	Map<OctantKey, Octant *>::Element *O = octant_map.find(p_ok);
-	if (!O) {
-		Octant *oct = memnew(Octant);
+void TileMap3D::_release_light(const ActiveLight &p_light) {
+	RenderingServer *rs = RenderingServer::get_singleton();
+	if ((int)light_pool.size() >= max_active_lights) {
+		rs->free(p_light.instance);
+		rs->free(p_light.light);
+		return;
+	}
+	rs->instance_set_visible(p_light.instance, false);
+	light_pool.push_back(p_light);
+}
 
-		O = octant_map.insert(p_ok, oct);
+void TileMap3D::_configure_light(ActiveLight &p_light, const TileData3DMesh::LightTileData3D &p_data) {
+	RenderingServer *rs = RenderingServer::get_singleton();
+	RID light = p_light.light;
+	p_light.energy = p_data.energy;
+	p_light.fade = -1.0; // Energy is set once the fade is known.
+	rs->light_set_color(light, p_data.color);
+	rs->light_set_param(light, RS::LIGHT_PARAM_INDIRECT_ENERGY, p_data.indirect_energy);
+	rs->light_set_param(light, RS::LIGHT_PARAM_SPECULAR, p_data.specular);
+	rs->light_set_param(light, RS::LIGHT_PARAM_RANGE, p_data.light_range);
+	rs->light_set_param(light, RS::LIGHT_PARAM_SIZE, p_data.size);
+	rs->light_set_param(light, RS::LIGHT_PARAM_ATTENUATION, p_data.attenuation);
+	rs->light_set_param(light, RS::LIGHT_PARAM_SPOT_ANGLE, p_data.spot_angle);
+	rs->light_set_param(light, RS::LIGHT_PARAM_SPOT_ATTENUATION, p_data.spot_angle_attenuation);
+	rs->light_set_param(light, RS::LIGHT_PARAM_SHADOW_BIAS, p_data.shadow_bias);
+	rs->light_set_param(light, RS::LIGHT_PARAM_SHADOW_NORMAL_BIAS, p_data.shadow_normal_bias);
+	rs->light_set_param(light, RS::LIGHT_PARAM_TRANSMITTANCE_BIAS, p_data.shadow_transmittance_bias);
+	rs->light_set_param(light, RS::LIGHT_PARAM_SHADOW_VOLUMETRIC_FOG_FADE, p_data.shadow_fog_fade);
+	rs->light_set_param(light, RS::LIGHT_PARAM_SHADOW_BLUR, p_data.shadow_blur);
+	rs->light_set_shadow(light, p_data.shadow_enabled);
+	rs->light_set_shadow_color(light, p_data.shadow_color);
+	rs->light_set_negative(light, p_data.negative);
+	rs->light_set_reverse_cull_face_mode(light, p_data.shadow_reverse_cull_face);
+	rs->light_set_projector(light, p_data.projector.is_valid() ? p_data.projector->get_rid() : RID());
+	if (p_light.type == TileData3DMesh::LIGHT_TYPE_OMNI) {
+		rs->light_omni_set_shadow_mode(light, p_data.omni_shadow_mode);
 	}
 
-	Octant &oct = *O->get();
-	oct.cells.insert(p_cell);
-	oct.dirty = true;
+	rs->instance_set_transform(p_light.instance, get_global_transform() * p_light.transform);
+	if (is_inside_tree()) {
+		rs->instance_set_visible(p_light.instance, is_visible_in_tree());
+	}
 }
 
-void TileMap3D::_mark_octants_as_dirty() {
-	for (KeyValue<OctantKey, Octant *> &E : octant_map) {
-		E.value->dirty = true;
+void TileMap3D::_release_active_lights() {
+	for (KeyValue<LightKey, ActiveLight> &E : active_lights) {
+		_release_light(E.value);
 	}
-	_queue_octants_dirty();
+	active_lights.clear();
 }
 
-void TileMap3D::_tileset_changed() {
-	_mark_octants_as_dirty();
-	_update_cell_vectors();
+void TileMap3D::_free_light_pool() {
+	RenderingServer *rs = RenderingServer::get_singleton();
+	for (uint32_t i = 0; i < light_pool.size(); i++) {
+		rs->free(light_pool[i].instance);
+		rs->free(light_pool[i].light);
+	}
+	light_pool.clear();
 }
 
 TileMap3D::OctantKey TileMap3D::_cell_to_octant(const MapCell &p_cell) const {
@@ -332,9 +2736,13 @@ void TileMap3D::_update_cell_vectors() {
 	if (tile_set.is_null()) {
 		cell_basis = Basis(Vector3(), Vector3(), Vector3());
 		_cell_offset = Vector3();
+		cell_inverse = cell_basis;
+		cell_lattice_skewed = false;
 		return;
 	}
 
+	cells_are_cuboid = tile_set->get_tile_shape() == TileSet3D::TILE_SHAPE_CUBOID;
+
 	int axis0 = tile_set->get_main_axis();
 	int axis1 = (axis0 + 1) % 3;
 	int axis2 = (axis0 + 2) % 3;
@@ -432,11 +2840,34 @@ void TileMap3D::_update_cell_vectors() {
 	for (int i = 0; i < 3; i++) {
 		cell_basis[i] *= cell_size;
 	}
+
+	// cell_basis rows are the lattice vectors, so local = cell_basis^T * cell.
+	if (Math::is_zero_approx(cell_basis.determinant())) {
+		cell_inverse = Basis(Vector3(), Vector3(), Vector3());
+	} else {
+		cell_inverse = cell_basis.inverse().transposed();
+	}
+	cell_plane_axes[0] = axis1;
+	cell_plane_axes[1] = axis2;
+
+	// A regular hexagon of circumradius 1 (before scaling by the cell size)
+	// contains the square inscribed in its incircle, of half side
+	// sqrt(3) / 2 / sqrt(2).
+	hex_inner_half_extents = Vector3();
+	if (!cells_are_cuboid) {
+		real_t half_side = Math_SQRT3 * 0.5 * Math_SQRT12;
+		hex_inner_half_extents[axis1] = half_side * cell_size[axis1];
+		hex_inner_half_extents[axis2] = half_side * cell_size[axis2];
+	}
+	cell_lattice_skewed = !Math::is_zero_approx(cell_basis[axis1].dot(cell_basis[axis2]));
 }
 
 void TileMap3D::_clear_layers() {
 	for (int i = 0; i < layers.size(); i++) {
-		layers[i].tile_map.clear();
+		layers[i].cells->clear();
+	}
+	for (KeyValue<MapTile::Tile, TileCache *> &E : tile_cache) {
+		E.value->cell_count = 0;
 	}
 }
 
@@ -453,8 +2884,11 @@ void TileMap3D::set_tile_set(const Ref<TileSet3D> &p_set) {
         tile_set->connect("changed", callable_mp(this, &TileMap3D::_tileset_changed));
     }
 
+	_refresh_tile_cache();
+	_update_cell_flags();
 	_mark_octants_as_dirty();
 	_update_cell_vectors();
+	_recreate_light_cells();
 }
 
 Ref<TileSet3D> TileMap3D::get_tileset() const {
@@ -465,7 +2899,9 @@ void TileMap3D::set_cell_scale(float p_scale) {
 	ERR_FAIL_COND(p_scale <= 0.0);
 	cell_scale = p_scale;
 
+	_refresh_tile_cache();
 	_mark_octants_as_dirty();
+	_recreate_light_cells();
 }
 
 float TileMap3D::get_cell_scale() const {
@@ -509,9 +2945,222 @@ bool TileMap3D::is_octant_centered_z() const {
 	return octant_center_z;
 }
 
+void TileMap3D::set_update_budget_usec(int p_usec) {
+	ERR_FAIL_COND(p_usec < 0);
+	update_budget_usec = p_usec;
+}
+
+int TileMap3D::get_update_budget_usec() const {
+	return update_budget_usec;
+}
+
+void TileMap3D::set_rid_pool_max_size(int p_size) {
+	ERR_FAIL_COND(p_size < 0);
+	rid_pool_max_size = p_size;
+	_trim_multimesh_pool(rid_pool_max_size);
+}
+
+int TileMap3D::get_rid_pool_max_size() const {
+	return rid_pool_max_size;
+}
+
+void TileMap3D::set_rid_pool_idle_size(int p_size) {
+	ERR_FAIL_COND(p_size < 0);
+	rid_pool_idle_size = p_size;
+	if (!awaiting_update) {
+		_trim_multimesh_pool(rid_pool_idle_size);
+	}
+}
+
+int TileMap3D::get_rid_pool_idle_size() const {
+	return rid_pool_idle_size;
+}
+
+int TileMap3D::get_pending_octant_count() const {
+	return dirty_octants.size();
+}
+
+void TileMap3D::set_cull_hidden_cells(bool p_enabled) {
+	if (cull_hidden_cells == p_enabled) {
+		return;
+	}
+	cull_hidden_cells = p_enabled;
+	_mark_octants_as_dirty();
+}
+
+bool TileMap3D::is_culling_hidden_cells() const {
+	return cull_hidden_cells;
+}
+
+void TileMap3D::set_occlusion_generate_boxes(bool p_enabled) {
+	if (occlusion_generate_boxes == p_enabled) {
+		return;
+	}
+	occlusion_generate_boxes = p_enabled;
+	for (KeyValue<OctantKey, Octant *> &E : octant_map) {
+		E.value->occluder_dirty = true;
+		_queue_octant(E.key, E.value);
+	}
+}
+
+bool TileMap3D::is_generating_occlusion_boxes() const {
+	return occlusion_generate_boxes;
+}
+
+void TileMap3D::set_max_active_lights(int p_count) {
+	ERR_FAIL_COND(p_count < 0);
+	max_active_lights = p_count;
+	while ((int)light_pool.size() > max_active_lights) {
+		RS::get_singleton()->free(light_pool[light_pool.size() - 1].instance);
+		RS::get_singleton()->free(light_pool[light_pool.size() - 1].light);
+		light_pool.resize(light_pool.size() - 1);
+	}
+	lights_dirty = true;
+}
+
+int TileMap3D::get_max_active_lights() const {
+	return max_active_lights;
+}
+
+void TileMap3D::set_light_fade_margin(float p_margin) {
+	ERR_FAIL_COND(p_margin < 0.0);
+	light_fade_margin = p_margin;
+	lights_dirty = true;
+}
+
+float TileMap3D::get_light_fade_margin() const {
+	return light_fade_margin;
+}
+
+void TileMap3D::set_light_update_distance(float p_distance) {
+	ERR_FAIL_COND(p_distance < 0.0);
+	light_update_distance = p_distance;
+	lights_dirty = true;
+}
+
+float TileMap3D::get_light_update_distance() const {
+	return light_update_distance;
+}
+
+int TileMap3D::get_tile_light_count() const {
+	int count = 0;
+	for (const KeyValue<MapCell, LocalVector<Transform3D>> &E : light_cells) {
+		count += E.value.size();
+	}
+	return count;
+}
+
+int TileMap3D::get_active_light_count() const {
+	return active_lights.size();
+}
+
+void TileMap3D::set_collision_layer(uint32_t p_layer) {
+	collision_layer = p_layer;
+	for (KeyValue<OctantKey, Octant *> &E : octant_map) {
+		for (List<Octant::OctantPhysicsLayer>::Element *F = E.value->physics.front(); F; F = F->next()) {
+			PhysicsServer3D::get_singleton()->body_set_collision_layer(F->get().body, collision_layer);
+		}
+	}
+}
+
+uint32_t TileMap3D::get_collision_layer() const {
+	return collision_layer;
+}
+
+void TileMap3D::set_collision_mask(uint32_t p_mask) {
+	collision_mask = p_mask;
+	for (KeyValue<OctantKey, Octant *> &E : octant_map) {
+		for (List<Octant::OctantPhysicsLayer>::Element *F = E.value->physics.front(); F; F = F->next()) {
+			PhysicsServer3D::get_singleton()->body_set_collision_mask(F->get().body, collision_mask);
+		}
+	}
+}
+
+uint32_t TileMap3D::get_collision_mask() const {
+	return collision_mask;
+}
+
+void TileMap3D::set_collision_mode(CollisionMode p_mode) {
+	if (collision_mode == p_mode) {
+		return;
+	}
+	collision_mode = p_mode;
+	for (KeyValue<OctantKey, Octant *> &E : octant_map) {
+		E.value->physics_dirty = true;
+		_queue_octant(E.key, E.value);
+	}
+}
+
+TileMap3D::CollisionMode TileMap3D::get_collision_mode() const {
+	return collision_mode;
+}
+
+void TileMap3D::set_bake_meshes(bool p_enabled) {
+	if (bake_meshes == p_enabled) {
+		return;
+	}
+	bake_meshes = p_enabled;
+	if (bake_meshes) {
+		for (const KeyValue<OctantKey, Octant *> &E : octant_map) {
+			_octant_queue_bake(E.key, E.value);
+		}
+	} else {
+		clear_baked_meshes();
+	}
+}
+
+bool TileMap3D::is_baking_meshes() const {
+	return bake_meshes;
+}
+
+void TileMap3D::make_baked_meshes() {
+	// Bring every octant up to date first.
+	if (awaiting_update && tile_set.is_valid()) {
+		_update_octant_range(0, dirty_octants.size());
+		dirty_octants.clear();
+		awaiting_update = false;
+	}
+
+	for (const KeyValue<OctantKey, Octant *> &E : octant_map) {
+		_octant_queue_bake(E.key, E.value);
+	}
+	_flush_octant_jobs();
+}
+
+void TileMap3D::clear_baked_meshes() {
+	// Pending bakes would bring the meshes back.
+	_finish_running_jobs();
+	for (uint32_t i = 0; i < queued_jobs.size(); i++) {
+		memdelete(queued_jobs[i]);
+	}
+	queued_jobs.clear();
+
+	for (const KeyValue<OctantKey, Octant *> &E : octant_map) {
+		_octant_clear_baked(E.value);
+		E.value->bake_version = 0;
+	}
+	_update_internal_processing();
+}
+
+Array TileMap3D::get_bake_meshes() const {
+	// Mesh and transform pairs, like GridMap.
+	Array arr;
+	for (const KeyValue<OctantKey, Octant *> &E : octant_map) {
+		for (uint32_t i = 0; i < E.value->baked_meshes.size(); i++) {
+			arr.push_back(E.value->baked_meshes[i].mesh);
+			arr.push_back(Transform3D());
+		}
+	}
+	return arr;
+}
+
 void TileMap3D::clear() {
 	_clear_octants();
 	_clear_layers();
+	path_graph.clear();
+	_release_active_lights();
+	light_cells.clear();
+	_update_internal_processing();
 }
 
 int TileMap3D::get_layers_count() const {
@@ -524,8 +3173,14 @@ void TileMap3D::add_layer(int p_to_pos) {
 	}
 	ERR_FAIL_INDEX(p_to_pos, (int)layers.size() + 1);
 
-	layers.insert(p_to_pos, TileMapLayer());
+	TileMapLayer layer;
+	layer.cells = memnew(CellStorage);
+	layers.insert(p_to_pos, layer);
 	notify_property_list_changed();
+
+	if (p_to_pos < layers.size() - 1) {
+		_recreate_octant_data();
+	}
 }
 
 void TileMap3D::move_layer(int p_layer, int p_to_pos) {
@@ -536,15 +3191,26 @@ void TileMap3D::move_layer(int p_layer, int p_to_pos) {
 	layers.insert(p_to_pos, tl);
 	layers.remove_at(p_to_pos < p_layer ? p_layer + 1 : p_layer);
 	notify_property_list_changed();
+
+	// Octant cells store their layer index.
+	_recreate_octant_data();
 }
 
 void TileMap3D::remove_layer(int p_layer) {
 	ERR_FAIL_INDEX(p_layer, layers.size());
 
+	const CellStorage &storage = *layers[p_layer].cells;
+	for (int i = 0; i < storage.get_chunk_count(); i++) {
+		const CellChunk *chunk = storage.get_chunk_by_index(i);
+		for (int k = chunk->next_used(0); k >= 0; k = chunk->next_used(k + 1)) {
+			_add_tile_cell_count(chunk->tiles[k], -1);
+		}
+	}
+	memdelete(layers[p_layer].cells);
 	layers.remove_at(p_layer);
 	notify_property_list_changed();
 
-	_queue_octants_dirty();
+	_recreate_octant_data();
 }
 
 void TileMap3D::set_layer_name(int p_layer, String p_name) {
@@ -559,7 +3225,40 @@ String TileMap3D::get_layer_name(int p_layer) const {
 
 void TileMap3D::set_layer_enabled(int p_layer, bool p_visible) {
 	ERR_FAIL_INDEX(p_layer, layers.size());
+	if (layers[p_layer].enabled == p_visible) {
+		return;
+	}
 	layers[p_layer].enabled = p_visible;
+	_update_layer_render_state(p_layer);
+	lights_dirty = true;
+	path_graph.clear();
+
+	// Disabled layers neither occlude nor hide cells of other layers. Only
+	// the octants around occluding or opaque cells of the layer change.
+	bool culling = _is_culling_hidden_cells();
+	const CellStorage &storage = *layers[p_layer].cells;
+	for (int i = 0; i < storage.get_chunk_count(); i++) {
+		const CellChunk *chunk = storage.get_chunk_by_index(i);
+		for (int k = chunk->next_used(0); k >= 0; k = chunk->next_used(k + 1)) {
+			bool opaque = chunk->flags[k] & CELL_FLAG_OPAQUE;
+			const TileCache *cache = _get_tile_cache(chunk->tiles[k]);
+			bool occludes = cache && (!cache->occlusion_indices.is_empty() || (occlusion_generate_boxes && opaque));
+			if (!occludes && !(culling && opaque)) {
+				continue;
+			}
+			MapCell cell(chunk->get_cell(k), p_layer);
+			if (occludes) {
+				OctantKey ok = _cell_to_octant(cell);
+				Map<OctantKey, Octant *>::Element *O = octant_map.find(ok);
+				ERR_CONTINUE(!O);
+				O->get()->occluder_dirty = true;
+				_queue_octant(ok, O->get());
+			}
+			if (culling && opaque) {
+				_mark_neighbors_dirty(cell);
+			}
+		}
+	}
 }
 
 bool TileMap3D::is_layer_enabled(int p_layer) const {
@@ -570,6 +3269,7 @@ bool TileMap3D::is_layer_enabled(int p_layer) const {
 void TileMap3D::set_layer_material_override(int p_layer, const Ref<Material> &p_material_override) {
 	ERR_FAIL_INDEX(p_layer, layers.size());
 	layers[p_layer].material_override = p_material_override;
+	_update_layer_render_state(p_layer);
 }
 
 Ref<Material> TileMap3D::get_layer_material_override(int p_layer) const {
@@ -580,6 +3280,7 @@ Ref<Material> TileMap3D::get_layer_material_override(int p_layer) const {
 void TileMap3D::set_layer_transparency(int p_layer, float p_transparency) {
 	ERR_FAIL_INDEX(p_layer, layers.size());
 	layers[p_layer].transparency = p_transparency;
+	_update_layer_render_state(p_layer);
 }
 
 float TileMap3D::get_layer_transparency(int p_layer) const {
@@ -590,6 +3291,7 @@ float TileMap3D::get_layer_transparency(int p_layer) const {
 void TileMap3D::set_layer_render_layers_mask(int p_layer, uint32_t p_mask) {
 	ERR_FAIL_INDEX(p_layer, layers.size());
 	layers[p_layer].render_layers = p_mask;
+	_update_layer_render_state(p_layer);
 }
 
 uint32_t TileMap3D::get_layer_render_layers_mask(int p_layer) const {
@@ -607,7 +3309,7 @@ void TileMap3D::set_layer_render_layer_mask_value(int p_layer, int p_render_laye
 	} else {
 		mask &= ~(1 << (p_render_layer_number - 1));
 	}
-	layers[p_layer].render_layers = mask;
+	set_layer_render_layers_mask(p_layer, mask);
 }
 
 bool TileMap3D::get_layer_render_layer_mask_value(int p_layer, int p_render_layer_number) const {
@@ -623,33 +3325,56 @@ void TileMap3D::set_cell(int p_layer, const Vector3i &p_position, int p_tile, in
 	ERR_FAIL_INDEX(ABS(p_position.y), (1 << 15) - 1);
 	ERR_FAIL_INDEX(ABS(p_position.z), (1 << 15) - 1);
 	ERR_FAIL_COND(p_collection < 0 && p_tile >= 0);
+	ERR_FAIL_INDEX(p_rot_idx, MapTile::ORTHOGONAL_ROT_COUNT);
 
 	MapCell cell(p_position, p_layer);
 
 	OctantKey ok = _cell_to_octant(cell);
-	Map<MapCell, MapTile> &tile_map = layers[p_layer].tile_map;
+	CellStorage &storage = *layers[p_layer].cells;
+
+	uint8_t old_flags = storage.get_flags(p_position);
+	MapTile old_mt;
+	bool had_tile = storage.get(p_position, old_mt);
 
 	if (p_tile < 0) {
 		// Erase
-		Map<MapCell, MapTile>::Element *E = tile_map.find(cell);
-		if (E) {
+		if (storage.erase(p_position)) {
+			_add_tile_cell_count(old_mt.tile, -1);
 			Map<OctantKey, Octant *>::Element *O = octant_map.find(ok);
 
 			ERR_FAIL_NULL(O);
 			Octant &oct = *O->get();
 			oct.cells.erase(cell);
-			oct.dirty = true;
-			tile_map.erase(cell);
-			_queue_octants_dirty();
+			oct.dirty_cells.insert(cell);
+			_queue_octant(ok, &oct);
+
+			if (_is_culling_hidden_cells() && (old_flags & CELL_FLAG_OPAQUE)) {
+				_mark_neighbors_dirty(p_position);
+			}
+			_update_cell_lights(cell);
+			_invalidate_path_cell(p_position);
 		}
 		return;
 	}
 
 	_insert_octant_cell(ok, cell);
 
-	MapTile tile(p_collection, p_tile, p_alternative, p_layer);
-	tile.set_ortho_rotation(p_rot_idx);
-	tile_map[cell] = tile;
+	MapTile mt(p_collection, p_tile, p_alternative, p_layer, p_rot_idx);
+	storage.set(p_position, mt);
+	if (had_tile) {
+		_add_tile_cell_count(old_mt.tile, -1);
+	}
+	_cache_tile(mt.tile);
+	_add_tile_cell_count(mt.tile, 1);
+	const TileCache *cache = _get_tile_cache(mt.tile);
+	uint8_t flags = cache ? cache->cell_flags : 0;
+	storage.set_flags(p_position, flags);
+
+	if (_is_culling_hidden_cells() && ((old_flags ^ flags) & CELL_FLAG_OPAQUE)) {
+		_mark_neighbors_dirty(p_position);
+	}
+	_update_cell_lights(cell);
+	_invalidate_path_cell(p_position);
 
 	_queue_octants_dirty();
 }
@@ -660,14 +3385,11 @@ int TileMap3D::get_cell_collection_id(int p_layer, const Vector3i &p_position) c
 	ERR_FAIL_INDEX_V(ABS(p_position.y), (1 << 15) - 1, -1);
 	ERR_FAIL_INDEX_V(ABS(p_position.z), (1 << 15) - 1, -1);
 
-	const Map<MapCell, MapTile> &tile_map = layers[p_layer].tile_map;
-	MapCell cell(p_position, p_layer);
-	const Map<MapCell, MapTile>::Element *E = tile_map.find(cell);
-
-	if (!E) {
+	MapTile mt;
+	if (!layers[p_layer].cells->get(p_position, mt)) {
 		return INVALID_ITEM;
 	} else {
-		return E->get().tile.collection_id;
+		return mt.tile.collection_id;
 	}
 }
 
@@ -677,14 +3399,11 @@ int TileMap3D::get_cell_tile_id(int p_layer, const Vector3i &p_position) const {
 	ERR_FAIL_INDEX_V(ABS(p_position.y), (1 << 15) - 1, -1);
 	ERR_FAIL_INDEX_V(ABS(p_position.z), (1 << 15) - 1, -1);
 
-	const Map<MapCell, MapTile> &tile_map = layers[p_layer].tile_map;
-	MapCell cell(p_position, p_layer);
-	const Map<MapCell, MapTile>::Element *E = tile_map.find(cell);
-
-	if (!E) {
+	MapTile mt;
+	if (!layers[p_layer].cells->get(p_position, mt)) {
 		return INVALID_ITEM;
 	} else {
-		return E->get().tile.tile_id;
+		return mt.tile.tile_id;
 	}
 }
 
@@ -694,14 +3413,11 @@ int TileMap3D::get_cell_alternative_id(int p_layer, const Vector3i &p_position)
 	ERR_FAIL_INDEX_V(ABS(p_position.y), (1 << 15) - 1, -1);
 	ERR_FAIL_INDEX_V(ABS(p_position.z), (1 << 15) - 1, -1);
 
-	const Map<MapCell, MapTile> &tile_map = layers[p_layer].tile_map;
-	MapCell cell(p_position, p_layer);
-	const Map<MapCell, MapTile>::Element *E = tile_map.find(cell);
-
-	if (!E) {
+	MapTile mt;
+	if (!layers[p_layer].cells->get(p_position, mt)) {
 		return INVALID_ITEM;
 	} else {
-		return E->get().tile.alternative_id;
+		return mt.tile.alternative_id;
 	}
 }
 
@@ -711,14 +3427,13 @@ void TileMap3D::set_cell_orientation_index(int p_layer, const Vector3i &p_positi
 	ERR_FAIL_INDEX(ABS(p_position.y), (1 << 15) - 1);
 	ERR_FAIL_INDEX(ABS(p_position.z), (1 << 15) - 1);
 
-	Map<MapCell, MapTile> &tile_map = layers[p_layer].tile_map;
-	MapCell cell(p_position, p_layer);
-	Map<MapCell, MapTile>::Element *E = tile_map.find(cell);
+	ERR_FAIL_INDEX(p_rot_idx, MapTile::ORTHOGONAL_ROT_COUNT);
 
-	ERR_FAIL_NULL_MSG(E, "No cell found with the given coordinates.");
+	bool found = layers[p_layer].cells->set_rotation_index(p_position, p_rot_idx);
+	ERR_FAIL_COND_MSG(!found, "No cell found with the given coordinates.");
 
-	MapTile &t = E->get();
-	t.set_ortho_rotation(p_rot_idx);
+	_mark_cell_dirty(MapCell(p_position, p_layer));
+	_update_cell_lights(MapCell(p_position, p_layer));
 }
 
 int TileMap3D::get_cell_closest_orientation_index(int p_layer, const Vector3i &p_position) const {
@@ -727,17 +3442,14 @@ int TileMap3D::get_cell_closest_orientation_index(int p_layer, const Vector3i &p
 	ERR_FAIL_INDEX_V(ABS(p_position.y), (1 << 15) - 1, -1);
 	ERR_FAIL_INDEX_V(ABS(p_position.z), (1 << 15) - 1, -1);
 
-	const Map<MapCell, MapTile> &tile_map = layers[p_layer].tile_map;
-	MapCell cell(p_position, p_layer);
-	const Map<MapCell, MapTile>::Element *E = tile_map.find(cell);
-
-	ERR_FAIL_NULL_V_MSG(E, -1, "No cell found with the given coordinates.");
+	const CellStorage &storage = *layers[p_layer].cells;
+	MapTile mt;
+	ERR_FAIL_COND_V_MSG(!storage.get(p_position, mt), -1, "No cell found with the given coordinates.");
 
-	const MapTile &t = E->get();
-	if (t.ortho_rot_idx != MapTile::NON_ORTHOGONAL_ROT) {
-		return t.ortho_rot_idx;
+	if (mt.is_orthogonal()) {
+		return mt.rot_idx;
 	} else {
-		return E->get().rotation.get_orthogonal_index();
+		return storage.get_rotation(p_position, mt.rot_idx).get_orthogonal_index();
 	}
 }
 
@@ -747,14 +3459,11 @@ void TileMap3D::set_cell_rotation(int p_layer, const Vector3i &p_position, const
 	ERR_FAIL_INDEX(ABS(p_position.y), (1 << 15) - 1);
 	ERR_FAIL_INDEX(ABS(p_position.z), (1 << 15) - 1);
 
-	Map<MapCell, MapTile> &tile_map = layers[p_layer].tile_map;
-	MapCell cell(p_position, p_layer);
-	Map<MapCell, MapTile>::Element *E = tile_map.find(cell);
-
-	ERR_FAIL_NULL_MSG(E, "No cell found with the given coordinates.");
+	bool found = layers[p_layer].cells->set_rotation(p_position, p_rotation);
+	ERR_FAIL_COND_MSG(!found, "No cell found with the given coordinates.");
 
-	MapTile &t = E->get();
-	t.set_rotation(p_rotation);
+	_mark_cell_dirty(MapCell(p_position, p_layer));
+	_update_cell_lights(MapCell(p_position, p_layer));
 }
 
 Basis TileMap3D::get_cell_rotation(int p_layer, const Vector3i &p_position) const {
@@ -763,13 +3472,11 @@ Basis TileMap3D::get_cell_rotation(int p_layer, const Vector3i &p_position) cons
 	ERR_FAIL_INDEX_V(ABS(p_position.y), (1 << 15) - 1, Basis());
 	ERR_FAIL_INDEX_V(ABS(p_position.z), (1 << 15) - 1, Basis());
 
-	const Map<MapCell, MapTile> &tile_map = layers[p_layer].tile_map;
-	MapCell cell(p_position, p_layer);
-	const Map<MapCell, MapTile>::Element *E = tile_map.find(cell);
-
-	ERR_FAIL_NULL_V_MSG(E, Basis(), "No cell found with the given coordinates.");
+	const CellStorage &storage = *layers[p_layer].cells;
+	MapTile mt;
+	ERR_FAIL_COND_V_MSG(!storage.get(p_position, mt), Basis(), "No cell found with the given coordinates.");
 
-	return E->get().rotation;
+	return storage.get_rotation(p_position, mt.rot_idx);
 }
 
 bool TileMap3D::is_cell_rotation_orthogonal(int p_layer, const Vector3i &p_position) const {
@@ -778,25 +3485,24 @@ bool TileMap3D::is_cell_rotation_orthogonal(int p_layer, const Vector3i &p_posit
 	ERR_FAIL_INDEX_V(ABS(p_position.y), (1 << 15) - 1, false);
 	ERR_FAIL_INDEX_V(ABS(p_position.z), (1 << 15) - 1, false);
 
-	const Map<MapCell, MapTile> &tile_map = layers[p_layer].tile_map;
-	MapCell cell(p_position, p_layer);
-	const Map<MapCell, MapTile>::Element *E = tile_map.find(cell);
-
-	ERR_FAIL_NULL_V_MSG(E, false, "No cell found with the given coordinates.");
+	MapTile mt;
+	ERR_FAIL_COND_V_MSG(!layers[p_layer].cells->get(p_position, mt), false, "No cell found with the given coordinates.");
 
-	return E->get().ortho_rot_idx != MapTile::NON_ORTHOGONAL_ROT;
+	return mt.is_orthogonal();
 }
 
 TypedArray<Vector3i> TileMap3D::get_used_cells(int p_layer) const {
 	ERR_FAIL_INDEX_V(p_layer, layers.size(), TypedArray<Vector3i>());
 	TypedArray<Vector3i> used;
-	TileMapLayer layer = layers[p_layer];
-	used.resize(layer.tile_map.size());
+	const CellStorage &storage = *layers[p_layer].cells;
+	used.resize(storage.size());
 	int idx = 0;
-	for (KeyValue<MapCell, MapTile> &E : layer.tile_map) {
-		Vector3i cell = E.key;
-		used[idx] = cell;
-		idx++;
+	for (int i = 0; i < storage.get_chunk_count(); i++) {
+		const CellChunk *chunk = storage.get_chunk_by_index(i);
+		for (int j = chunk->next_used(0); j >= 0; j = chunk->next_used(j + 1)) {
+			used[idx] = chunk->get_cell(j);
+			idx++;
+		}
 	}
 	return used;
 }
@@ -806,15 +3512,16 @@ Rect2i TileMap3D::get_used_cells_rect_proj(Vector3::Axis p_axis) const {
 	Vector3i max = Vector3i(INT32_MIN, INT32_MIN, INT32_MIN);
 	int has_cells = 0;
 	for (int i = 0; i < layers.size(); i++) {
-		TileMapLayer layer = layers[i];
-		int idx = 0;
-		for (KeyValue<MapCell, MapTile> &E : layer.tile_map) {
-			Vector3i cell = E.key;
-			min = Vector3i(MIN(min.x, cell.x), MIN(min.y, cell.y), MIN(min.z, cell.z));
-			max = Vector3i(MAX(max.x, cell.x), MAX(max.y, cell.y), MAX(max.z, cell.z));
-			idx++;
+		const CellStorage &storage = *layers[i].cells;
+		for (int j = 0; j < storage.get_chunk_count(); j++) {
+			const CellChunk *chunk = storage.get_chunk_by_index(j);
+			for (int k = chunk->next_used(0); k >= 0; k = chunk->next_used(k + 1)) {
+				Vector3i cell = chunk->get_cell(k);
+				min = Vector3i(MIN(min.x, cell.x), MIN(min.y, cell.y), MIN(min.z, cell.z));
+				max = Vector3i(MAX(max.x, cell.x), MAX(max.y, cell.y), MAX(max.z, cell.z));
+			}
 		}
-		has_cells += idx;
+		has_cells += storage.size();
 	}
 
 	if (has_cells == 0) {
@@ -836,6 +3543,212 @@ Vector3 TileMap3D::cell_to_local(const Vector3i &p_cell) const {
 	return cell_basis[0] * p_cell.x + cell_basis[1] * p_cell.y + cell_basis[2] * p_cell.z + _cell_offset;
 }
 
+AABB TileMap3D::get_octant_aabb(const Vector3i &p_cell) const {
+	const Map<OctantKey, Octant *>::Element *O = octant_map.find(_cell_to_octant(MapCell(p_cell)));
+	if (!O) {
+		return AABB();
+	}
+	return O->get()->aabb;
+}
+
+Vector3i TileMap3D::local_to_cell(const Vector3 &p_local) const {
+	Vector3 coords = cell_inverse.xform(p_local - _cell_offset);
+	if (cell_lattice_skewed) {
+		return _nearest_lattice_cell(p_local, coords);
+	}
+	return Vector3i(Math::floor(coords.x + 0.5), Math::floor(coords.y + 0.5), Math::floor(coords.z + 0.5));
+}
+
+Vector3i TileMap3D::_nearest_lattice_cell(const Vector3 &p_local, const Vector3 &p_coords) const {
+	// The main axis is perpendicular to the other two and can be rounded.
+	// In the plane, the nearest lattice point is one of the corners of the
+	// parallelogram containing the point.
+	int a1 = cell_plane_axes[0];
+	int a2 = cell_plane_axes[1];
+	Vector3i base = Vector3i(Math::floor(p_coords.x + 0.5), Math::floor(p_coords.y + 0.5), Math::floor(p_coords.z + 0.5));
+	base[a1] = Math::floor(p_coords[a1]);
+	base[a2] = Math::floor(p_coords[a2]);
+
+	Vector3i best = base;
+	real_t best_dist = -1.0;
+	for (int i = 0; i < 4; i++) {
+		Vector3i cell = base;
+		cell[a1] += i & 1;
+		cell[a2] += i >> 1;
+		real_t dist = cell_to_local(cell).distance_squared_to(p_local);
+		if (best_dist < 0.0 || dist < best_dist) {
+			best = cell;
+			best_dist = dist;
+		}
+	}
+	return best;
+}
+
+void TileMap3D::cells_to_local(const Vector3i *p_cells, Vector3 *r_points, int p_count) const {
+	TileMap3DSIMD::cells_to_local(cell_basis, _cell_offset, p_cells, r_points, p_count);
+}
+
+void TileMap3D::local_to_cells(const Vector3 *p_points, Vector3i *r_cells, int p_count) const {
+	LocalVector<Vector3> coords;
+	coords.resize(p_count);
+	TileMap3DSIMD::local_to_coords(cell_inverse, _cell_offset, p_points, coords.ptr(), p_count);
+	if (!cell_lattice_skewed) {
+		TileMap3DSIMD::round_coords(coords.ptr(), r_cells, p_count);
+		return;
+	}
+	for (int i = 0; i < p_count; i++) {
+		r_cells[i] = _nearest_lattice_cell(p_points[i], coords[i]);
+	}
+}
+
+PackedVector3Array TileMap3D::_cells_to_local_bind(const TypedArray<Vector3i> &p_cells) const {
+	LocalVector<Vector3i> cells;
+	cells.resize(p_cells.size());
+	for (uint32_t i = 0; i < cells.size(); i++) {
+		cells[i] = p_cells[i];
+	}
+	PackedVector3Array points;
+	points.resize(cells.size());
+	cells_to_local(cells.ptr(), points.ptrw(), cells.size());
+	return points;
+}
+
+TypedArray<Vector3i> TileMap3D::_local_to_cells_bind(const PackedVector3Array &p_points) const {
+	LocalVector<Vector3i> cells;
+	cells.resize(p_points.size());
+	local_to_cells(p_points.ptr(), cells.ptr(), p_points.size());
+	TypedArray<Vector3i> ret;
+	ret.resize(cells.size());
+	for (uint32_t i = 0; i < cells.size(); i++) {
+		ret[i] = cells[i];
+	}
+	return ret;
+}
+
+class TileMap3D::CellPathGrid : public TileMap3DPathGraph::ClusterGrid {
+public:
+	const TileMap3D *tilemap = nullptr;
+	real_t uniform_cost = 0.0;
+
+	virtual real_t get_cell_cost(const Vector3i &p_cell) const override {
+		return tilemap->_get_cell_walk_cost(p_cell, uniform_cost);
+	}
+
+	virtual uint64_t get_cell_cluster(const Vector3i &p_cell) const override {
+		return tilemap->_cell_to_octant(MapCell(p_cell)).key;
+	}
+
+	virtual void get_cluster_cells(uint64_t p_cluster, LocalVector<Vector3i> &r_cells) const override {
+		// Walkable cells always hold a tile, so they are all in the octant.
+		OctantKey key;
+		key.key = p_cluster;
+		const Map<OctantKey, Octant *>::Element *O = tilemap->octant_map.find(key);
+		if (!O) {
+			return;
+		}
+		for (const Set<MapCell>::Element *E = O->get()->cells.front(); E; E = E->next()) {
+			r_cells.push_back(E->get());
+		}
+	}
+};
+
+real_t TileMap3D::_get_cell_walk_cost(const Vector3i &p_cell, real_t p_uniform_cost) const {
+	real_t cost = -1.0;
+	int ci = CellChunk::get_cell_index(p_cell);
+	for (int i = 0; i < layers.size(); i++) {
+		if (!layers[i].enabled) {
+			continue;
+		}
+		const CellChunk *chunk = layers[i].cells->get_chunk(p_cell);
+		if (!chunk || !chunk->has(ci)) {
+			continue;
+		}
+		if (!(chunk->flags[ci] & CELL_FLAG_WALKABLE)) {
+			return -1.0;
+		}
+		if (p_uniform_cost > 0.0) {
+			// Every walkable tile costs the same, no need to look it up.
+			cost = p_uniform_cost;
+			continue;
+		}
+		const TileCache *cache = _get_tile_cache(chunk->tiles[ci]);
+		cost = MAX(cost, cache ? cache->walk_cost : 1.0);
+	}
+	return cost;
+}
+
+bool TileMap3D::_get_walk_cost_range(real_t &r_min, real_t &r_max) const {
+	// Cached tiles whose cells were all erased don't count.
+	r_min = Math_INF;
+	r_max = 0.0;
+	for (const Map<MapTile::Tile, TileCache *>::Element *E = tile_cache.front(); E; E = E->next()) {
+		const TileCache *cache = E->get();
+		if (cache->cell_count > 0 && cache->data.is_valid() && (cache->cell_flags & CELL_FLAG_WALKABLE)) {
+			r_min = MIN(r_min, cache->walk_cost);
+			r_max = MAX(r_max, cache->walk_cost);
+		}
+	}
+	return r_max > 0.0;
+}
+
+void TileMap3D::_invalidate_path_cell(const Vector3i &p_cell) {
+	if (!path_hierarchical) {
+		return; // The graph is dropped when disabled.
+	}
+	// Portals of the clusters around the cell may start or end at it.
+	for (int x = -1; x <= 1; x++) {
+		for (int y = -1; y <= 1; y++) {
+			for (int z = -1; z <= 1; z++) {
+				path_graph.invalidate_cluster(_cell_to_octant(MapCell(p_cell + Vector3i(x, y, z))).key);
+			}
+		}
+	}
+}
+
+bool TileMap3D::find_cell_path(const Vector3i &p_from, const Vector3i &p_to, LocalVector<Vector3i> &r_path) {
+	r_path.clear();
+	ERR_FAIL_COND_V(tile_set.is_null(), false);
+	real_t min_cost;
+	real_t max_cost;
+	if (!_get_walk_cost_range(min_cost, max_cost)) {
+		return false;
+	}
+
+	// Cached cluster costs stay valid when the cost range changes, so the
+	// grid always reports the actual costs.
+	CellPathGrid grid;
+	grid.tilemap = this;
+	grid.uniform_cost = min_cost == max_cost ? min_cost : 0.0;
+	TileMap3DPathfinder pathfinder;
+	pathfinder.set_lattice(!cells_are_cuboid, 3 - cell_plane_axes[0] - cell_plane_axes[1], cell_basis);
+	if (path_hierarchical) {
+		return path_graph.find_path(pathfinder, grid, p_from, p_to, min_cost, min_cost == max_cost, r_path);
+	}
+	return pathfinder.find_path(grid, p_from, p_to, min_cost, min_cost == max_cost, r_path);
+}
+
+void TileMap3D::set_path_hierarchical(bool p_enabled) {
+	path_hierarchical = p_enabled;
+	if (!path_hierarchical) {
+		path_graph.clear();
+	}
+}
+
+bool TileMap3D::is_path_hierarchical() const {
+	return path_hierarchical;
+}
+
+TypedArray<Vector3i> TileMap3D::_find_cell_path_bind(const Vector3i &p_from, const Vector3i &p_to) {
+	LocalVector<Vector3i> path;
+	find_cell_path(p_from, p_to, path);
+	TypedArray<Vector3i> ret;
+	ret.resize(path.size());
+	for (uint32_t i = 0; i < path.size(); i++) {
+		ret[i] = path[i];
+	}
+	return ret;
+}
+
 void TileMap3D::_notification(int p_what) {
 	switch (p_what) {
 		case NOTIFICATION_ENTER_WORLD: {
@@ -844,6 +3757,18 @@ void TileMap3D::_notification(int p_what) {
 			for (const KeyValue<OctantKey, Octant *> &E : octant_map) {
 				_octant_enter_world(E.value);
 			}
+			for (uint32_t i = 0; i < multimesh_pool.size(); i++) {
+				RS::get_singleton()->instance_set_scenario(multimesh_pool[i].instance, get_world_3d()->get_scenario());
+				RS::get_singleton()->instance_set_transform(multimesh_pool[i].instance, last_transform);
+			}
+			for (const KeyValue<LightKey, ActiveLight> &E : active_lights) {
+				RS::get_singleton()->instance_set_scenario(E.value.instance, get_world_3d()->get_scenario());
+				RS::get_singleton()->instance_set_transform(E.value.instance, last_transform * E.value.transform);
+			}
+			for (uint32_t i = 0; i < light_pool.size(); i++) {
+				RS::get_singleton()->instance_set_scenario(light_pool[i].instance, get_world_3d()->get_scenario());
+			}
+			lights_dirty = true;
 		} break;
 		case NOTIFICATION_TRANSFORM_CHANGED: {
 			Transform3D new_xform = get_global_transform();
@@ -854,6 +3779,12 @@ void TileMap3D::_notification(int p_what) {
 			for (const KeyValue<OctantKey, Octant *> &E : octant_map) {
 				_octant_transform(E.value);
 			}
+			for (uint32_t i = 0; i < multimesh_pool.size(); i++) {
+				RS::get_singleton()->instance_set_transform(multimesh_pool[i].instance, new_xform);
+			}
+			for (const KeyValue<LightKey, ActiveLight> &E : active_lights) {
+				RS::get_singleton()->instance_set_transform(E.value.instance, new_xform * E.value.transform);
+			}
 
 			last_transform = new_xform;
 		} break;
@@ -861,10 +3792,24 @@ void TileMap3D::_notification(int p_what) {
 			for (const KeyValue<OctantKey, Octant *> &E : octant_map) {
 				_octant_exit_world(E.value);
 			}
+			for (uint32_t i = 0; i < multimesh_pool.size(); i++) {
+				RS::get_singleton()->instance_set_scenario(multimesh_pool[i].instance, RID());
+			}
+			for (const KeyValue<LightKey, ActiveLight> &E : active_lights) {
+				RS::get_singleton()->instance_set_scenario(E.value.instance, RID());
+			}
+			for (uint32_t i = 0; i < light_pool.size(); i++) {
+				RS::get_singleton()->instance_set_scenario(light_pool[i].instance, RID());
+			}
 		} break;
 		case NOTIFICATION_VISIBILITY_CHANGED: {
 			_update_visibility();
 		} break;
+		case NOTIFICATION_INTERNAL_PROCESS: {
+			_update_octants_callback();
+			_process_octant_jobs();
+			_update_lights();
+		} break;
 	}
 }
 
@@ -890,20 +3835,116 @@ void TileMap3D::_bind_methods() {
 	ClassDB::bind_method(D_METHOD("is_octant_centered_y"), &TileMap3D::is_octant_centered_y);
 	ClassDB::bind_method(D_METHOD("set_octant_center_z", "center"), &TileMap3D::set_octant_center_z);
 	ClassDB::bind_method(D_METHOD("is_octant_centered_z"), &TileMap3D::is_octant_centered_z);
+	ClassDB::bind_method(D_METHOD("set_update_budget_usec", "usec"), &TileMap3D::set_update_budget_usec);
+	ClassDB::bind_method(D_METHOD("get_update_budget_usec"), &TileMap3D::get_update_budget_usec);
+	ClassDB::bind_method(D_METHOD("cell_to_local", "cell"), &TileMap3D::cell_to_local);
+	ClassDB::bind_method(D_METHOD("local_to_cell", "local_position"), &TileMap3D::local_to_cell);
+	ClassDB::bind_method(D_METHOD("cells_to_local", "cells"), &TileMap3D::_cells_to_local_bind);
+	ClassDB::bind_method(D_METHOD("local_to_cells", "local_positions"), &TileMap3D::_local_to_cells_bind);
+	ClassDB::bind_method(D_METHOD("get_octant_aabb", "cell"), &TileMap3D::get_octant_aabb);
+	ClassDB::bind_method(D_METHOD("find_cell_path", "from", "to"), &TileMap3D::_find_cell_path_bind);
+	ClassDB::bind_method(D_METHOD("set_path_hierarchical", "enabled"), &TileMap3D::set_path_hierarchical);
+	ClassDB::bind_method(D_METHOD("is_path_hierarchical"), &TileMap3D::is_path_hierarchical);
+	ClassDB::bind_method(D_METHOD("set_rid_pool_max_size", "size"), &TileMap3D::set_rid_pool_max_size);
+	ClassDB::bind_method(D_METHOD("get_rid_pool_max_size"), &TileMap3D::get_rid_pool_max_size);
+	ClassDB::bind_method(D_METHOD("set_rid_pool_idle_size", "size"), &TileMap3D::set_rid_pool_idle_size);
+	ClassDB::bind_method(D_METHOD("get_rid_pool_idle_size"), &TileMap3D::get_rid_pool_idle_size);
+	ClassDB::bind_method(D_METHOD("get_pending_octant_count"), &TileMap3D::get_pending_octant_count);
+	ClassDB::bind_method(D_METHOD("set_cull_hidden_cells", "enabled"), &TileMap3D::set_cull_hidden_cells);
+	ClassDB::bind_method(D_METHOD("is_culling_hidden_cells"), &TileMap3D::is_culling_hidden_cells);
+	ClassDB::bind_method(D_METHOD("set_occlusion_generate_boxes", "enabled"), &TileMap3D::set_occlusion_generate_boxes);
+	ClassDB::bind_method(D_METHOD("is_generating_occlusion_boxes"), &TileMap3D::is_generating_occlusion_boxes);
+	ClassDB::bind_method(D_METHOD("set_max_active_lights", "count"), &TileMap3D::set_max_active_lights);
+	ClassDB::bind_method(D_METHOD("get_max_active_lights"), &TileMap3D::get_max_active_lights);
+	ClassDB::bind_method(D_METHOD("set_light_fade_margin", "margin"), &TileMap3D::set_light_fade_margin);
+	ClassDB::bind_method(D_METHOD("get_light_fade_margin"), &TileMap3D::get_light_fade_margin);
+	ClassDB::bind_method(D_METHOD("set_light_update_distance", "distance"), &TileMap3D::set_light_update_distance);
+	ClassDB::bind_method(D_METHOD("get_light_update_distance"), &TileMap3D::get_light_update_distance);
+	ClassDB::bind_method(D_METHOD("get_tile_light_count"), &TileMap3D::get_tile_light_count);
+	ClassDB::bind_method(D_METHOD("get_active_light_count"), &TileMap3D::get_active_light_count);
+	ClassDB::bind_method(D_METHOD("set_collision_layer", "layer"), &TileMap3D::set_collision_layer);
+	ClassDB::bind_method(D_METHOD("get_collision_layer"), &TileMap3D::get_collision_layer);
+	ClassDB::bind_method(D_METHOD("set_collision_mask", "mask"), &TileMap3D::set_collision_mask);
+	ClassDB::bind_method(D_METHOD("get_collision_mask"), &TileMap3D::get_collision_mask);
+	ClassDB::bind_method(D_METHOD("set_collision_mode", "mode"), &TileMap3D::set_collision_mode);
+	ClassDB::bind_method(D_METHOD("get_collision_mode"), &TileMap3D::get_collision_mode);
+	ClassDB::bind_method(D_METHOD("set_bake_meshes", "enabled"), &TileMap3D::set_bake_meshes);
+	ClassDB::bind_method(D_METHOD("is_baking_meshes"), &TileMap3D::is_baking_meshes);
+	ClassDB::bind_method(D_METHOD("make_baked_meshes"), &TileMap3D::make_baked_meshes);
+	ClassDB::bind_method(D_METHOD("clear_baked_meshes"), &TileMap3D::clear_baked_meshes);
+	ClassDB::bind_method(D_METHOD("get_bake_meshes"), &TileMap3D::get_bake_meshes);
 
 	ADD_PROPERTY(PropertyInfo(Variant::OBJECT, "tile_set", PROPERTY_HINT_RESOURCE_TYPE, "TileSet3D"), "set_tile_set", "get_tileset");
 	ADD_PROPERTY(PropertyInfo(Variant::FLOAT, "cell_scale"), "set_cell_scale", "get_cell_scale");
+	ADD_PROPERTY(PropertyInfo(Variant::BOOL, "cull_hidden_cells"), "set_cull_hidden_cells", "is_culling_hidden_cells");
 	ADD_GROUP("Octant", "octant_");
 	ADD_PROPERTY(PropertyInfo(Variant::VECTOR3, "octant_size"), "set_octant_size", "get_octant_size");
 	ADD_PROPERTY(PropertyInfo(Variant::BOOL, "octant_center_x"), "set_octant_center_x", "is_octant_centered_x");
 	ADD_PROPERTY(PropertyInfo(Variant::BOOL, "octant_center_y"), "set_octant_center_y", "is_octant_centered_y");
 	ADD_PROPERTY(PropertyInfo(Variant::BOOL, "octant_center_z"), "set_octant_center_z", "is_octant_centered_z");
+	ADD_GROUP("Update", "update_");
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "update_budget_usec", PROPERTY_HINT_RANGE, "0,100000,1,or_greater"), "set_update_budget_usec", "get_update_budget_usec");
+	ADD_GROUP("Collision", "collision_");
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "collision_layer", PROPERTY_HINT_LAYERS_3D_PHYSICS), "set_collision_layer", "get_collision_layer");
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "collision_mask", PROPERTY_HINT_LAYERS_3D_PHYSICS), "set_collision_mask", "get_collision_mask");
+	// Merged boxes replace the shapes of full-cell box tiles, cuboid cells only.
+	// A baked trimesh replaces the concave, convex and box shapes of an octant.
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "collision_mode", PROPERTY_HINT_ENUM, "Cell Shapes,Merged Boxes,Baked Trimesh"), "set_collision_mode", "get_collision_mode");
+	ADD_GROUP("Path", "path_");
+	ADD_PROPERTY(PropertyInfo(Variant::BOOL, "path_hierarchical"), "set_path_hierarchical", "is_path_hierarchical");
+	ADD_GROUP("Lights", "");
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "max_active_lights", PROPERTY_HINT_RANGE, "0,256,1,or_greater"), "set_max_active_lights", "get_max_active_lights");
+	ADD_PROPERTY(PropertyInfo(Variant::FLOAT, "light_fade_margin", PROPERTY_HINT_RANGE, "0,16,0.01,or_greater"), "set_light_fade_margin", "get_light_fade_margin");
+	ADD_PROPERTY(PropertyInfo(Variant::FLOAT, "light_update_distance", PROPERTY_HINT_RANGE, "0,16,0.01,or_greater"), "set_light_update_distance", "get_light_update_distance");
+	ADD_GROUP("Occlusion", "occlusion_");
+	// Box occluders covering the cells of opaque full-cell tiles.
+	ADD_PROPERTY(PropertyInfo(Variant::BOOL, "occlusion_generate_boxes"), "set_occlusion_generate_boxes", "is_generating_occlusion_boxes");
+	ADD_GROUP("Bake", "bake_");
+	ADD_PROPERTY(PropertyInfo(Variant::BOOL, "bake_meshes"), "set_bake_meshes", "is_baking_meshes");
+	ADD_GROUP("RID Pool", "rid_pool_");
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "rid_pool_max_size", PROPERTY_HINT_RANGE, "0,4096,1,or_greater"), "set_rid_pool_max_size", "get_rid_pool_max_size");
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "rid_pool_idle_size", PROPERTY_HINT_RANGE, "0,4096,1,or_greater"), "set_rid_pool_idle_size", "get_rid_pool_idle_size");
+
+	BIND_ENUM_CONSTANT(COLLISION_MODE_CELL_SHAPES);
+	BIND_ENUM_CONSTANT(COLLISION_MODE_MERGED_BOXES);
+	BIND_ENUM_CONSTANT(COLLISION_MODE_BAKED_TRIMESH);
 }
 
 TileMap3D::TileMap3D() {
 	set_notify_transform(true);
 }
 
+void TileMap3D::init_thread_pool() {
+	thread_pool = memnew(ThreadWorkPool);
+	thread_pool->init();
+	job_pool = memnew(ThreadWorkPool);
+	job_pool->init();
+}
+
+void TileMap3D::finish_thread_pool() {
+	thread_pool->finish();
+	memdelete(thread_pool);
+	thread_pool = nullptr;
+	job_pool->finish();
+	memdelete(job_pool);
+	job_pool = nullptr;
+}
+
 TileMap3D::~TileMap3D() {
+	if (!running_jobs.is_empty()) {
+		job_pool->end_work();
+	}
+	for (uint32_t i = 0; i < running_jobs.size(); i++) {
+		memdelete(running_jobs[i]);
+	}
+	for (uint32_t i = 0; i < queued_jobs.size(); i++) {
+		memdelete(queued_jobs[i]);
+	}
 	clear();
+	_trim_multimesh_pool(0);
+	_free_light_pool();
+	_clear_tile_cache();
+	for (int i = 0; i < layers.size(); i++) {
+		memdelete(layers[i].cells);
+	}
 }
@@ -31,9 +31,13 @@
 #ifndef TILE_MAP_3D_H
 #define TILE_MAP_3D_H
 
+#include "core/templates/hash_map.h"
 #include "core/templates/local_vector.h"
+#include "core/templates/safe_refcount.h"
+#include "core/templates/thread_work_pool.h"
 #include "scene/3d/node_3d.h"
 #include "scene/resources/multimesh.h"
+#include "tile_map_3d_path.h"
 #include "tile_set_3d.h"
 
 #define Math_SQRT3 1.7320508075688772935274463415058724
@@ -41,7 +45,17 @@
 class TileMap3D : public Node3D {
 	GDCLASS(TileMap3D, Node3D);
 
+public:
+	enum CollisionMode {
+		COLLISION_MODE_CELL_SHAPES,
+		COLLISION_MODE_MERGED_BOXES,
+		COLLISION_MODE_BAKED_TRIMESH,
+	};
+
 private:
+	static const int INSTANCE_TRANSFORM_STRIDE = 12;
+	// Octants updated between two checks of the time budget.
+	static const int OCTANT_UPDATE_BATCH = 16;
 
 	Ref<TileSet3D> tile_set;
 	float cell_scale = 1.0;
@@ -49,9 +63,16 @@ private:
 	bool octant_center_x = true;
     bool octant_center_y = true;
     bool octant_center_z = true;
+	int update_budget_usec = 0; // 0 means no limit.
+	int rid_pool_max_size = 256;
+	int rid_pool_idle_size = 32; // Pool size kept once all updates are done.
 
+	// Compact cell record: an 8 byte tile key and an orthogonal rotation index.
+	// Cells with an arbitrary rotation use NON_ORTHOGONAL_ROT and keep their
+	// basis in CellStorage::custom_rotations.
 	struct MapTile {
-		static const int NON_ORTHOGONAL_ROT = -1;
+		static const uint8_t NON_ORTHOGONAL_ROT = 0xFF;
+		static const int ORTHOGONAL_ROT_COUNT = 24;
 
 		union Tile {
 			struct {
@@ -66,8 +87,16 @@ private:
 				return _u64t < p_tile._u64t;
 			}
 
+			_FORCE_INLINE_ bool operator==(const Tile &p_tile) const {
+				return _u64t == p_tile._u64t;
+			}
+
+			_FORCE_INLINE_ bool operator!=(const Tile &p_tile) const {
+				return _u64t != p_tile._u64t;
+			}
+
 			Tile(int p_collection_id = -1, int p_tile_id = -1, int p_alternative_id = -1, int p_layer = -1) {
-				collection_id = p_alternative_id;
+				collection_id = p_collection_id;
 				tile_id = p_tile_id;
 				alternative_id = p_alternative_id;
 				layer = p_layer;
@@ -75,31 +104,18 @@ private:
 		};
 
 		Tile tile;
-		Basis rotation;
-		int ortho_rot_idx;
-
-		void operator=(const MapTile &t) {
-			tile.collection_id = t.tile.collection_id;
-			tile.tile_id = t.tile.tile_id;
-			tile.alternative_id = t.tile.alternative_id;
-			ortho_rot_idx = t.ortho_rot_idx;
-			rotation = t.rotation;
-		}
-
-		void set_ortho_rotation(int p_index) {
-			ortho_rot_idx = p_index;
-			rotation.set_orthogonal_index(p_index);
-		}
+		uint8_t rot_idx = 0;
 
-		void set_rotation(const Basis &p_rot) {
-			rotation = p_rot;
-			ortho_rot_idx = NON_ORTHOGONAL_ROT;
+		_FORCE_INLINE_ bool is_orthogonal() const {
+			return rot_idx != NON_ORTHOGONAL_ROT;
 		}
 
-		MapTile(int p_collection_id = -1, int p_tile_id = -1, int p_alternative_id = -1, int p_layer = -1) :
-			tile(p_collection_id, p_tile_id, p_alternative_id, p_layer) {}
+		MapTile(int p_collection_id = -1, int p_tile_id = -1, int p_alternative_id = -1, int p_layer = -1, int p_rot_idx = 0) :
+			tile(p_collection_id, p_tile_id, p_alternative_id, p_layer), rot_idx(p_rot_idx) {}
 	};
 
+	static const Basis &_get_orthogonal_basis(int p_index);
+
 	union MapCell {
 		struct {
 			int16_t x;
@@ -153,21 +169,128 @@ private:
 		}
 	};
 
+	// Main thread snapshot of the tile data needed to build octants, so the
+	// worker threads never touch the TileSet3D.
+	struct TileCache {
+		Ref<TileData3DMesh> data;
+		RID mesh;
+		RID shadow_mesh; // Only set when the tile casts shadows.
+		Transform3D mesh_transform;
+		AABB mesh_aabb;
+		uint8_t cell_flags = 0;
+		float walk_cost = 1.0;
+		int cell_count = 0; // Cells using the tile, in any layer.
+		// rotation * cell_scale * mesh_transform for each orthogonal rotation,
+		// the cell position only has to be added to the origin.
+		Transform3D rotated_transforms[MapTile::ORTHOGONAL_ROT_COUNT];
+		// Mesh bounds under each of the above, without the origin.
+		AABB rotated_aabbs[MapTile::ORTHOGONAL_ROT_COUNT];
+		PackedVector3Array occlusion_vertices;
+		PackedInt32Array occlusion_indices;
+		// Only filled once the tile is baked.
+		Vector<Array> surface_arrays;
+		Vector<Ref<Material>> surface_materials;
+		// Triangles of the shapes of each physics data entry, in tile space.
+		// Only filled in baked trimesh collision mode.
+		Vector<PackedVector3Array> collision_faces;
+		// Navigation mesh of each navigation data entry in tile space, with
+		// polygons stored as their vertex count followed by their indices.
+		// Only filled once the tile is part of a navigation region.
+		Vector<PackedVector3Array> navigation_vertices;
+		Vector<PackedInt32Array> navigation_polygons;
+	};
+
 	struct Octant {
+		// Static body holding the shapes of one physics layer. Tiles with
+		// different velocities get separate bodies.
 		struct OctantPhysicsLayer {
+			int layer_id = -1;
+			Vector3 linear_velocity;
+			Vector3 angular_velocity;
 			RID body;
+			// Cell of each shape slot. Merged box slots map to the minimum
+			// cell of the box, not to the cell a contact actually hit.
 			Map<int, MapCell> shapes_cell;
+			Map<MapCell, LocalVector<int>> cell_shapes;
+			// Disabled shape slots left by removed cells, reused before
+			// adding new ones so shape indices never shift.
+			LocalVector<int> free_shapes;
+			// Cells whose shape is a single full cell box. With merged boxes
+			// they are covered by box_shapes instead of a shape each.
+			Set<MapCell> box_cells;
+			bool boxes_dirty = false;
+			// Box shapes owned by the layer, each in its own slot. Unused
+			// ones are disabled and kept for the next merge.
+			LocalVector<RID> box_shapes;
+			LocalVector<int> box_slots;
+			// Cells whose triangle shapes are merged into trimesh_shape. The
+			// shape is kept once created and only gets new faces.
+			Set<MapCell> trimesh_cells;
+			bool trimesh_dirty = false;
+			RID trimesh_shape;
+			int trimesh_slot = -1;
+		};
+
+		// Region merging the navigation meshes of one navigation layer.
+		struct OctantNavigationLayer {
+			int layer_id = -1;
+			RID region;
+			Ref<NavigationMesh> navmesh;
 		};
 
 		struct MultimeshInstance {
 			RID instance;
 			RID multimesh;
+			MapTile::Tile tile;
+			int capacity = 0;
+			// Shadows only multimesh drawing the shadow mesh of the tile with
+			// the same transforms. Invalid when the tile has none.
+			RID shadow_instance;
+			RID shadow_multimesh;
+			int shadow_capacity = 0;
+			LocalVector<MapCell> cells; // Cell drawn by each visible instance.
+			AABB aabb; // Local bounds, may be larger than needed after removals.
+		};
+
+		struct BakedMesh {
+			int layer = 0;
+			Ref<ArrayMesh> mesh;
+			RID instance;
+		};
+
+		// Output of the threaded build phase, consumed by _octant_commit().
+		struct MultimeshBuild {
+			MapTile::Tile tile;
+			const TileCache *cache = nullptr;
+			int capacity = 0;
+			LocalVector<MapCell> cells;
+			LocalVector<uint8_t> rotations;
+			Vector<float> buffer;
+			AABB aabb;
 		};
 
 		Set<MapCell> cells;
-		bool dirty = false;
+		bool dirty = false; // Needs a full rebuild.
+		bool queued = false; // Already in dirty_octants.
+		uint64_t version = 0; // Changes every time the octant is updated.
+		uint64_t bake_version = 0; // Version a bake job was queued for.
+		uint64_t collision_bake_version = 0; // Version of the pending collision job, 0 if none.
+		uint64_t navigation_version = 0; // Version of the pending navigation job, 0 if none.
+		AABB aabb; // Merged bounds of the multimesh instances.
+		Set<MapCell> dirty_cells; // Cells to patch in place.
 		LocalVector<MultimeshInstance, int> multimesh_instances;
+		LocalVector<MultimeshBuild> build;
+		LocalVector<BakedMesh> baked_meshes; // Drawn instead of the multimeshes when not empty.
+		// Occlusion geometry of every cell, merged. Kept across rebuilds and
+		// only freed once the octant has no occlusion geometry left.
+		RID occluder;
+		RID occluder_instance;
+		bool occluder_dirty = false;
+		bool physics_dirty = false; // Bodies need a full rebuild.
+		PackedVector3Array occluder_vertices; // Filled on a worker thread.
+		PackedInt32Array occluder_indices;
 		List<OctantPhysicsLayer> physics;
+		LocalVector<OctantNavigationLayer> navigation;
 
 		// struct MultimeshInstance {
 		// 	RID instance;
@@ -197,6 +320,279 @@ private:
 	};
 
 	Map<OctantKey, Octant *> octant_map;
+	LocalVector<OctantKey> dirty_octants;
+	uint64_t last_octant_version = 0;
+
+	// Work computed on a worker thread for one octant and applied on the main
+	// thread. The result is dropped if the octant changed in the meantime.
+	class OctantJob {
+	public:
+		OctantKey key;
+		uint64_t version = 0;
+
+		virtual void process() = 0;
+		virtual void apply(TileMap3D *p_tilemap, Octant *p_oct) = 0;
+		virtual ~OctantJob() {}
+	};
+
+	// Merges the surfaces of every cell sharing a layer and a material.
+	class OctantBakeJob : public OctantJob {
+	public:
+		struct Surface {
+			int layer = 0;
+			Ref<Material> material;
+			LocalVector<Array> arrays;
+			LocalVector<Transform3D> transforms;
+			Array result;
+		};
+
+		LocalVector<Surface> surfaces;
+
+		virtual void process() override;
+		virtual void apply(TileMap3D *p_tilemap, Octant *p_oct) override;
+	};
+
+	// Merges the triangle shapes of every cell sharing a physics layer into
+	// one concave shape.
+	class OctantCollisionJob : public OctantJob {
+	public:
+		struct PhysicsLayer {
+			int layer_id = -1;
+			Vector3 linear_velocity;
+			Vector3 angular_velocity;
+			LocalVector<PackedVector3Array> faces;
+			LocalVector<Transform3D> transforms;
+			PackedVector3Array result;
+		};
+
+		LocalVector<PhysicsLayer> physics_layers;
+
+		virtual void process() override;
+		virtual void apply(TileMap3D *p_tilemap, Octant *p_oct) override;
+	};
+
+	// Merges the navigation meshes of every cell sharing a navigation layer.
+	class OctantNavigationJob : public OctantJob {
+	public:
+		struct NavigationLayer {
+			int layer_id = -1;
+			LocalVector<PackedVector3Array> vertices;
+			LocalVector<PackedInt32Array> polygons;
+			LocalVector<Transform3D> transforms;
+			PackedVector3Array result_vertices;
+			Vector<Vector<int>> result_polygons;
+		};
+
+		LocalVector<NavigationLayer> navigation_layers;
+
+		virtual void process() override;
+		virtual void apply(TileMap3D *p_tilemap, Octant *p_oct) override;
+	};
+
+	LocalVector<OctantJob *> queued_jobs;
+	LocalVector<OctantJob *> running_jobs;
+	SafeNumeric<uint32_t> finished_jobs;
+
+	// Shared by all maps, jobs run on it without blocking the main thread.
+	// A map waits while another one is using it.
+	static ThreadWorkPool *job_pool;
+
+	void _queue_octant_job(OctantJob *p_job);
+	void _octant_job_thread(uint32_t p_index, OctantJob **p_jobs);
+	void _process_octant_jobs();
+	void _finish_running_jobs();
+	void _flush_octant_jobs();
+	void _apply_octant_jobs(LocalVector<OctantJob *> &p_jobs);
+	void _update_internal_processing();
+
+	bool bake_meshes = false;
+	uint32_t collision_layer = 1;
+	uint32_t collision_mask = 1;
+	CollisionMode collision_mode = COLLISION_MODE_CELL_SHAPES;
+
+	_FORCE_INLINE_ bool _is_merging_collision_boxes() const { return collision_mode == COLLISION_MODE_MERGED_BOXES && cells_are_cuboid; }
+	bool _is_full_cell_box(const Vector<TileData3DMesh::ShapeData> &p_shapes, const Basis &p_cell_basis) const;
+	void _octant_update_physics(const OctantKey &p_key, Octant *p_oct);
+	void _octant_reset_physics(Octant *p_oct);
+	void _octant_add_cell_shapes(Octant *p_oct, const MapCell &p_cell);
+	void _octant_remove_cell_shapes(Octant *p_oct, const MapCell &p_cell);
+	void _octant_merge_physics_boxes(Octant::OctantPhysicsLayer *p_layer);
+	void _octant_queue_collision_bake(const OctantKey &p_key, Octant *p_oct);
+	void _octant_set_trimesh(Octant::OctantPhysicsLayer *p_layer, const PackedVector3Array &p_faces);
+	void _cache_tile_collision_faces(TileCache *p_cache);
+
+	void _octant_update_navigation(const OctantKey &p_key, Octant *p_oct);
+	void _octant_queue_navigation(const OctantKey &p_key, Octant *p_oct);
+	void _octant_free_navigation(Octant *p_oct);
+	void _cache_tile_navigation(TileCache *p_cache);
+	Octant::OctantPhysicsLayer *_octant_get_physics_layer(Octant *p_oct, int p_layer_id, const Vector3 &p_linear_velocity, const Vector3 &p_angular_velocity);
+	static int _physics_layer_add_shape(Octant::OctantPhysicsLayer *p_layer, RID p_shape, const Transform3D &p_transform);
+	static void _physics_layer_remove_shape(Octant::OctantPhysicsLayer *p_layer, int p_index);
+	void _octant_free_physics(Octant *p_oct);
+	bool occlusion_generate_boxes = false;
+
+	// Block of cells, in cell coordinates.
+	struct CellBox {
+		Vector3i position;
+		Vector3i size;
+	};
+
+	// Greedily merges the given cells into as few boxes as it can, growing
+	// them first along p_first_axis, then the next axes in x, y, z order.
+	// Axes missing from p_grow_axes are not grown along. Duplicated cells are
+	// allowed.
+	static void _merge_cell_boxes(const LocalVector<Vector3i> &p_cells, LocalVector<CellBox> &r_boxes, int p_grow_axes = 0x7, int p_first_axis = 0);
+	void _append_box_occluder(const CellBox &p_box, PackedVector3Array &r_vertices, PackedInt32Array &r_indices) const;
+
+	bool cull_hidden_cells = false;
+	bool cells_are_cuboid = true;
+
+	_FORCE_INLINE_ bool _is_culling_hidden_cells() const { return cull_hidden_cells && cells_are_cuboid; }
+	bool _is_cell_opaque(const Vector3i &p_cell) const;
+	bool _is_cell_hidden(const Vector3i &p_cell) const;
+	void _mark_neighbors_dirty(const Vector3i &p_cell);
+	void _update_cell_flags();
+
+	void _octant_queue_bake(const OctantKey &p_key, Octant *p_oct);
+	void _octant_clear_baked(Octant *p_oct);
+	void _cache_tile_surfaces(TileCache *p_cache);
+
+	// Lights carried by tiles. Only the max_active_lights nearest to the
+	// camera get a light instance, taken from a pool, and they fade out
+	// before the next light in line replaces them.
+	struct LightKey {
+		MapCell cell;
+		int index = 0;
+
+		_FORCE_INLINE_ bool operator<(const LightKey &p_key) const {
+			return cell.key == p_key.cell.key ? index < p_key.index : cell.key < p_key.cell.key;
+		}
+	};
+
+	struct ActiveLight {
+		RID light;
+		RID instance;
+		TileData3DMesh::LightType type = TileData3DMesh::LIGHT_TYPE_OMNI;
+		Transform3D transform; // Local to the map.
+		float energy = 0.0; // Before fading.
+		float fade = -1.0;
+	};
+
+	struct LightCandidate {
+		LightKey key;
+		real_t distance = 0.0;
+
+		_FORCE_INLINE_ bool operator<(const LightCandidate &p_other) const {
+			return distance < p_other.distance;
+		}
+	};
+
+	int max_active_lights = 16;
+	float light_fade_margin = 2.0;
+	float light_update_distance = 0.5; // Camera move, in local units, that reassigns the pooled lights.
+	bool lights_dirty = false;
+	Vector3 last_light_origin;
+	Map<MapCell, LocalVector<Transform3D>> light_cells; // Local transform of each light of the cell tile.
+	Map<LightKey, ActiveLight> active_lights;
+	LocalVector<ActiveLight> light_pool;
+
+	void _update_cell_lights(const MapCell &p_cell);
+	void _recreate_light_cells();
+	void _update_lights();
+	ActiveLight _acquire_light(TileData3DMesh::LightType p_type);
+	void _release_light(const ActiveLight &p_light);
+	void _configure_light(ActiveLight &p_light, const TileData3DMesh::LightTileData3D &p_data);
+	void _release_active_lights();
+	void _free_light_pool();
+
+	struct PendingOctant {
+		OctantKey key;
+		real_t distance = 0.0;
+
+		_FORCE_INLINE_ bool operator<(const PendingOctant &p_other) const {
+			return distance < p_other.distance;
+		}
+	};
+
+	// Dense block of SIZE^3 cells stored as parallel arrays of tile keys and
+	// rotation indices (9 bytes per cell). Cells are laid out with x varying
+	// fastest, so walking a chunk in index order walks contiguous memory.
+	enum CellFlags {
+		CELL_FLAG_OPAQUE = 1 << 0, // Tile is an opaque full cell.
+		CELL_FLAG_WALKABLE = 1 << 1, // Cell paths can go through the tile.
+	};
+
+	struct CellChunk {
+		static const int SHIFT = 3;
+		static const int SIZE = 1 << SHIFT;
+		static const int MASK = SIZE - 1;
+		static const int CELL_COUNT = SIZE * SIZE * SIZE;
+		static const int WORD_COUNT = CELL_COUNT / 64;
+
+		uint64_t key = 0;
+		Vector3i origin;
+		uint32_t list_index = 0;
+		int count = 0;
+		uint64_t used[WORD_COUNT] = {};
+		MapTile::Tile tiles[CELL_COUNT];
+		uint8_t rotations[CELL_COUNT];
+		uint8_t flags[CELL_COUNT]; // CellFlags derived from the tile data.
+
+		_FORCE_INLINE_ static int get_cell_index(const Vector3i &p_cell) {
+			return (p_cell.x & MASK) | ((p_cell.y & MASK) << SHIFT) | ((p_cell.z & MASK) << (SHIFT * 2));
+		}
+
+		_FORCE_INLINE_ Vector3i get_cell(int p_index) const {
+			return origin + Vector3i(p_index & MASK, (p_index >> SHIFT) & MASK, p_index >> (SHIFT * 2));
+		}
+
+		_FORCE_INLINE_ bool has(int p_index) const {
+			return used[p_index >> 6] & (uint64_t(1) << (p_index & 63));
+		}
+
+		// Returns the first used index greater or equal than p_from, or -1.
+		int next_used(int p_from) const;
+	};
+
+	// Sparse set of chunks keyed by chunk coordinate. Replaces a tree of cells so
+	// that memory per cell is the size of the tile record and lookups are a hash
+	// probe plus an index.
+	class CellStorage {
+		HashMap<uint64_t, CellChunk *> chunk_map;
+		LocalVector<CellChunk *> chunks;
+		Map<Vector3i, Basis> custom_rotations;
+		int cell_count = 0;
+
+		CellChunk *_get_chunk(const Vector3i &p_cell) const;
+
+	public:
+		_FORCE_INLINE_ static uint64_t get_chunk_key(const Vector3i &p_cell) {
+			OctantKey k(p_cell.x >> CellChunk::SHIFT, p_cell.y >> CellChunk::SHIFT, p_cell.z >> CellChunk::SHIFT);
+			return k.key;
+		}
+
+		const CellChunk *get_chunk(const Vector3i &p_cell) const;
+		// Returns the index of the cell inside r_chunk, or -1 if the cell is
+		// empty. r_chunk is reused if the cell falls inside it, which makes
+		// loops visiting cells in order skip most chunk lookups.
+		int find(const Vector3i &p_cell, const CellChunk *&r_chunk) const;
+		bool get(const Vector3i &p_cell, MapTile &r_tile) const;
+		void set(const Vector3i &p_cell, const MapTile &p_tile);
+		bool set_rotation_index(const Vector3i &p_cell, int p_rot_idx);
+		bool set_rotation(const Vector3i &p_cell, const Basis &p_rotation);
+		uint8_t get_flags(const Vector3i &p_cell) const;
+		void set_flags(const Vector3i &p_cell, uint8_t p_flags);
+		Basis get_rotation(const Vector3i &p_cell, int p_rot_idx) const;
+		bool erase(const Vector3i &p_cell);
+		void clear();
+
+		_FORCE_INLINE_ int size() const { return cell_count; }
+		_FORCE_INLINE_ int get_chunk_count() const { return chunks.size(); }
+		_FORCE_INLINE_ const CellChunk *get_chunk_by_index(int p_index) const { return chunks[p_index]; }
+		_FORCE_INLINE_ CellChunk *get_chunk_by_index(int p_index) { return chunks[p_index]; }
+
+		~CellStorage() { clear(); }
+	};
 
 	struct TileMapLayer {
 		String name;
@@ -204,7 +600,7 @@ private:
 		Ref<Material> material_override;
 		float transparency = 0.0;
 		uint32_t render_layers = 1; // ADD_PROPERTY(PropertyInfo(Variant::INT, "layers", PROPERTY_HINT_LAYERS_3D_RENDER), "set_layer_mask", "get_layer_mask");
-		Map<MapCell, MapTile> tile_map;
+		CellStorage *cells = nullptr;
 	};
 
 	LocalVector<TileMapLayer, int> layers;
@@ -212,15 +608,64 @@ private:
 	Map<MapCell, RID> multimeshes;
 	Map<MapCell, int> instance_indices;
 
+	// Keyed by tile without its layer.
+	Map<MapTile::Tile, TileCache *> tile_cache;
+
+	static ThreadWorkPool *thread_pool;
+
+	// Multimesh and instance pairs released by rebuilt octants. Pooled
+	// instances stay bound to the scenario and follow the node transform.
+	struct PooledMultimesh {
+		RID instance;
+		RID multimesh;
+		int capacity = 0;
+	};
+
+	LocalVector<PooledMultimesh> multimesh_pool;
+
+	PooledMultimesh _acquire_multimesh(int p_capacity);
+	void _release_multimesh(RID p_instance, RID p_multimesh, int p_capacity);
+	void _trim_multimesh_pool(int p_size);
+
 	bool awaiting_update = false;
 	Transform3D last_transform;
 
 	Basis cell_basis;
 	Vector3 _cell_offset;
+	Basis cell_inverse; // Maps (local - _cell_offset) to lattice coordinates.
+	// Set when the two in-plane lattice vectors are not perpendicular (hex
+	// prisms, stretched diamonds). Rounding each coordinate is not enough
+	// then and the nearest lattice point has to be searched.
+	bool cell_lattice_skewed = false;
+	int cell_plane_axes[2] = { 1, 2 };
+	// Half size of an axis aligned box fitting inside any hexagonal prism
+	// cell, along the two axes of its plane.
+	Vector3 hex_inner_half_extents;
+
+	Vector3i _nearest_lattice_cell(const Vector3 &p_local, const Vector3 &p_coords) const;
+	PackedVector3Array _cells_to_local_bind(const TypedArray<Vector3i> &p_cells) const;
+	TypedArray<Vector3i> _local_to_cells_bind(const PackedVector3Array &p_points) const;
+
+	// Cell paths go through cells holding only walkable tiles in the enabled
+	// layers, at the highest walk cost among them.
+	class CellPathGrid;
+	real_t _get_cell_walk_cost(const Vector3i &p_cell, real_t p_uniform_cost) const;
+	bool _get_walk_cost_range(real_t &r_min, real_t &r_max) const;
+	TypedArray<Vector3i> _find_cell_path_bind(const Vector3i &p_from, const Vector3i &p_to);
+
+	// Hierarchical cell paths use the octants as clusters. Editing a cell
+	// invalidates the clusters around it, anything changing walkability or
+	// octant membership everywhere drops the whole graph.
+	bool path_hierarchical = false;
+	TileMap3DPathGraph path_graph;
+	void _invalidate_path_cell(const Vector3i &p_cell);
 
 	void _queue_octants_dirty();
 	void _recreate_octant_data();
 	void _update_octants_callback();
+	void _update_octant_range(uint32_t p_from, uint32_t p_to);
+	void _sort_dirty_octants();
+	Vector3 _get_octant_center(const OctantKey &p_key) const;
 	void _update_visibility();
 
 	void _clear_octants();
@@ -228,8 +673,52 @@ private:
 	void _octant_enter_world(Octant *p_oct);
 	void _octant_exit_world(Octant *p_oct);
 	void _octant_transform(Octant *p_oct);
-	bool _octant_update(Octant *p_oct);
+	enum OctantUpdate {
+		OCTANT_UPDATE_NONE,
+		OCTANT_UPDATE_BUILD,
+		OCTANT_UPDATE_EMPTY
+	};
+
+	OctantUpdate _octant_update(Octant *p_oct);
+	void _octant_prepare_thread(uint32_t p_index, Octant **p_octants);
+	void _octant_prepare(Octant *p_oct) const;
+	void _octant_commit(Octant *p_oct);
+	void _multimesh_set_visible(const Octant::MultimeshInstance &p_mmi, bool p_visible);
+	void _multimesh_set_instance_transform(const Octant::MultimeshInstance &p_mmi, int p_slot, const Transform3D &p_transform);
+	void _multimesh_set_visible_instances(const Octant::MultimeshInstance &p_mmi, int p_count);
+	void _apply_render_settings(RID p_instance, const TileCache &p_cache, int p_layer);
+	void _apply_layer_render_settings(RID p_instance, const TileCache *p_cache, int p_layer);
+	void _update_layer_render_state(int p_layer);
+	_FORCE_INLINE_ bool _is_layer_visible(int p_layer) const { return is_visible_in_tree() && layers[p_layer].enabled; }
+	void _octant_prepare_occluder_thread(uint32_t p_index, Octant **p_octants);
+	void _octant_prepare_occluder(Octant *p_oct) const;
+	void _octant_commit_occluder(Octant *p_oct);
+	void _octant_free_occluder(Octant *p_oct);
+	bool _octant_patch(Octant *p_oct);
+	void _octant_remove_instance(Octant *p_oct, int p_mmi, int p_slot);
+	int _octant_find_multimesh(const Octant *p_oct, const MapTile::Tile &p_tile) const;
+	void _octant_grow_aabb(Octant *p_oct, int p_mmi, const AABB &p_aabb);
+	AABB _get_instance_aabb(const MapTile &p_tile, const TileCache &p_cache, const Transform3D &p_transform) const;
+	const TileCache *_get_cell_data(const MapCell &p_cell, MapTile &r_tile) const;
+	Transform3D _get_cell_transform(const MapCell &p_cell, const MapTile &p_tile, const TileCache &p_cache) const;
+	// Cell placement without the mesh transform, for the data attached to tiles.
+	Transform3D _get_cell_base_transform(const MapCell &p_cell, const MapTile &p_tile) const;
+	Transform3D _get_cell_transform(const MapCell &p_cell, const MapTile &p_tile, const TileCache &p_cache, const Vector3 &p_origin) const;
+
+	static _FORCE_INLINE_ MapTile::Tile _get_tile_cache_key(MapTile::Tile p_tile) {
+		p_tile.layer = -1;
+		return p_tile;
+	}
+	const TileCache *_get_tile_cache(const MapTile::Tile &p_tile) const;
+	void _cache_tile(const MapTile::Tile &p_tile);
+	void _add_tile_cell_count(const MapTile::Tile &p_tile, int p_count);
+	void _update_tile_cache_entry(const MapTile::Tile &p_key, TileCache *p_cache);
+	void _refresh_tile_cache();
+	void _clear_tile_cache();
+	static void _write_instance_transform(float *p_ptr, const Transform3D &p_transform);
 	void _insert_octant_cell(const OctantKey &p_ok, const MapCell &p_cell);
+	void _mark_cell_dirty(const MapCell &p_cell);
+	void _queue_octant(const OctantKey &p_key, Octant *p_oct);
 	void _mark_octants_as_dirty();
 	void _tileset_changed();
 
@@ -249,6 +738,9 @@ protected:
 public:
 	static const int INVALID_ITEM = -1;
 
+	static void init_thread_pool();
+	static void finish_thread_pool();
+
 	void set_tile_set(const Ref<TileSet3D> &p_set);
 	Ref<TileSet3D> get_tileset() const;
 	void set_cell_scale(float p_scale);
@@ -261,6 +753,42 @@ public:
 	bool is_octant_centered_y() const;
 	void set_octant_center_z(bool p_center);
 	bool is_octant_centered_z() const;
+	void set_update_budget_usec(int p_usec);
+	int get_update_budget_usec() const;
+	void set_rid_pool_max_size(int p_size);
+	int get_rid_pool_max_size() const;
+	void set_rid_pool_idle_size(int p_size);
+	int get_rid_pool_idle_size() const;
+
+	int get_pending_octant_count() const;
+
+	void set_cull_hidden_cells(bool p_enabled);
+	bool is_culling_hidden_cells() const;
+
+	void set_occlusion_generate_boxes(bool p_enabled);
+	bool is_generating_occlusion_boxes() const;
+
+	void set_max_active_lights(int p_count);
+	int get_max_active_lights() const;
+	void set_light_fade_margin(float p_margin);
+	float get_light_fade_margin() const;
+	void set_light_update_distance(float p_distance);
+	float get_light_update_distance() const;
+	int get_tile_light_count() const;
+	int get_active_light_count() const;
+
+	void set_collision_layer(uint32_t p_layer);
+	uint32_t get_collision_layer() const;
+	void set_collision_mask(uint32_t p_mask);
+	uint32_t get_collision_mask() const;
+	void set_collision_mode(CollisionMode p_mode);
+	CollisionMode get_collision_mode() const;
+
+	void set_bake_meshes(bool p_enabled);
+	bool is_baking_meshes() const;
+	void make_baked_meshes();
+	void clear_baked_meshes();
+	Array get_bake_meshes() const;
 
 	void clear();
 
@@ -296,6 +824,22 @@ public:
 	Basis get_cell_basis_vectors() const;
 
 	Vector3 cell_to_local(const Vector3i &p_cell) const;
+	// Returns the cell whose cell_to_local() position is nearest to p_local.
+	Vector3i local_to_cell(const Vector3 &p_local) const;
+	void cells_to_local(const Vector3i *p_cells, Vector3 *r_points, int p_count) const;
+	void local_to_cells(const Vector3 *p_points, Vector3i *r_cells, int p_count) const;
+
+	// Bounds of the octant containing p_cell, in local space. Empty until the
+	// octant has been built.
+	AABB get_octant_aabb(const Vector3i &p_cell) const;
+
+	// Cheapest path between two walkable cells, both included. Moving costs
+	// the distance between cell centers times the walk cost of the cell
+	// entered. Empty if there is none. Hierarchical searches trade a slightly
+	// longer path for a bounded search over octants.
+	bool find_cell_path(const Vector3i &p_from, const Vector3i &p_to, LocalVector<Vector3i> &r_path);
+	void set_path_hierarchical(bool p_enabled);
+	bool is_path_hierarchical() const;
 
 	// set_layer_transparency
 
@@ -303,4 +847,6 @@ public:
 	~TileMap3D();
 };
 
+VARIANT_ENUM_CAST(TileMap3D::CollisionMode);
+
 #endif // TILE_MAP_3D_H
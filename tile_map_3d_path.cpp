@@ -0,0 +1,683 @@
+/*************************************************************************/
+/*  tile_map_3d_path.cpp                                                 */
+/*************************************************************************/
+/*                       This file is part of:                           */
+/*                           GODOT ENGINE                                */
+/*                      https://godotengine.org                          */
+/*************************************************************************/
+/* Copyright (c) 2007-2021 Juan Linietsky, Ariel Manzur.                 */
+/* Copyright (c) 2014-2021 Godot Engine contributors (cf. AUTHORS.md).   */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#include "tile_map_3d_path.h"
+
+// Binary min heap over open list entries.
+template <class T>
+static void _open_push(LocalVector<T> &r_open, const T &p_entry) {
+	r_open.push_back(p_entry);
+	int i = r_open.size() - 1;
+	while (i > 0) {
+		int parent = (i - 1) / 2;
+		if (!(r_open[i] < r_open[parent])) {
+			break;
+		}
+		SWAP(r_open[i], r_open[parent]);
+		i = parent;
+	}
+}
+
+template <class T>
+static T _open_pop(LocalVector<T> &r_open) {
+	T top = r_open[0];
+	r_open[0] = r_open[r_open.size() - 1];
+	r_open.resize(r_open.size() - 1);
+	int count = r_open.size();
+	int i = 0;
+	while (true) {
+		int best = i;
+		int left = i * 2 + 1;
+		int right = left + 1;
+		if (left < count && r_open[left] < r_open[best]) {
+			best = left;
+		}
+		if (right < count && r_open[right] < r_open[best]) {
+			best = right;
+		}
+		if (best == i) {
+			break;
+		}
+		SWAP(r_open[i], r_open[best]);
+		i = best;
+	}
+	return top;
+}
+
+void TileMap3DPathfinder::set_lattice(bool p_hexagonal, int p_main_axis, const Basis &p_cell_basis) {
+	hexagonal = p_hexagonal;
+	main_axis = p_main_axis;
+	plane_axes[0] = (p_main_axis + 1) % 3;
+	plane_axes[1] = (p_main_axis + 2) % 3;
+
+	step_count = 0;
+	auto add_step_pair = [&](const Vector3i &p_step) {
+		Vector3 offset = p_cell_basis[0] * p_step.x + p_cell_basis[1] * p_step.y + p_cell_basis[2] * p_step.z;
+		steps[step_count] = p_step;
+		steps[step_count + 1] = -p_step;
+		step_lengths[step_count] = offset.length();
+		step_lengths[step_count + 1] = step_lengths[step_count];
+		step_count += 2;
+	};
+
+	Vector3i e[3] = { Vector3i(1, 0, 0), Vector3i(0, 1, 0), Vector3i(0, 0, 1) };
+	if (!hexagonal) {
+		for (int i = 0; i < 3; i++) {
+			add_step_pair(e[i]);
+		}
+		return;
+	}
+
+	// The two plane lattice vectors are 60 or 120 degrees apart, depending
+	// on the layout, orientation and inverted axes. The sixth neighbor is
+	// along their sum when they are 120 degrees apart, along their
+	// difference otherwise.
+	add_step_pair(e[main_axis]);
+	add_step_pair(e[plane_axes[0]]);
+	add_step_pair(e[plane_axes[1]]);
+	diagonal_sign = p_cell_basis[plane_axes[0]].dot(p_cell_basis[plane_axes[1]]) < 0.0 ? 1 : -1;
+	add_step_pair(e[plane_axes[0]] + e[plane_axes[1]] * diagonal_sign);
+}
+
+real_t TileMap3DPathfinder::get_distance(const Vector3i &p_from, const Vector3i &p_to) const {
+	Vector3i d = p_to - p_from;
+	if (!hexagonal) {
+		// Steps along different axes never replace each other.
+		return ABS(d.x) * step_lengths[0] + ABS(d.y) * step_lengths[2] + ABS(d.z) * step_lengths[4];
+	}
+
+	// Hexagonal distance in the plane. The diagonal covers one unit of each
+	// plane axis when their signs agree with diagonal_sign.
+	int d0 = d[plane_axes[0]];
+	int d1 = d[plane_axes[1]] * diagonal_sign;
+	int plane_steps = (d0 > 0) == (d1 > 0) ? MAX(ABS(d0), ABS(d1)) : ABS(d0) + ABS(d1);
+	real_t plane_length = MIN(step_lengths[2], MIN(step_lengths[4], step_lengths[6]));
+	return ABS(d[main_axis]) * step_lengths[0] + plane_steps * plane_length;
+}
+
+real_t TileMap3DPathfinder::_heuristic(const Vector3i &p_cell) const {
+	return min_cost > 0.0 ? get_distance(p_cell, goal) * min_cost : 0.0;
+}
+
+int TileMap3DPathfinder::_get_node(const Vector3i &p_cell) {
+	uint64_t key = get_cell_key(p_cell);
+	int *N = node_map.getptr(key);
+	if (N) {
+		return *N;
+	}
+	Node node;
+	node.cell = p_cell;
+	node.g = Math_INF;
+	nodes.push_back(node);
+	node_map.set(key, nodes.size() - 1);
+	return nodes.size() - 1;
+}
+
+void TileMap3DPathfinder::_relax(int p_parent, const Vector3i &p_cell, int p_step, real_t p_g) {
+	int idx = _get_node(p_cell);
+	Node &node = nodes[idx];
+	// The heuristic is consistent, closed nodes can not get cheaper.
+	if (node.closed || p_g >= node.g) {
+		return;
+	}
+	node.g = p_g;
+	node.parent = p_parent;
+	node.step = p_step;
+
+	OpenEntry entry;
+	entry.f = p_g + _heuristic(p_cell);
+	entry.g = p_g;
+	entry.node = idx;
+	_open_push(open, entry);
+}
+
+bool TileMap3DPathfinder::_jump(const Vector3i &p_from, int p_step, Vector3i &r_cell) const {
+	// Shortest paths are taken in canonical order, steps along higher axes
+	// before steps along lower ones. A cell is a jump point when that order
+	// has to be broken to reach a neighbor, or when a jump along a lower axis
+	// from it finds one.
+	const Vector3i &step = steps[p_step];
+	int axis = p_step >> 1;
+	Vector3i cell = p_from;
+	while (true) {
+		Vector3i prev = cell;
+		cell += step;
+		if (!_is_walkable(cell)) {
+			return false;
+		}
+		if (cell == goal) {
+			r_cell = cell;
+			return true;
+		}
+		for (int i = 0; i < 6; i++) {
+			if ((i >> 1) != axis && _is_walkable(cell + steps[i]) && !_is_walkable(prev + steps[i])) {
+				r_cell = cell;
+				return true;
+			}
+		}
+		for (int i = 0; i < axis * 2; i++) {
+			Vector3i found;
+			if (_jump(cell, i, found)) {
+				r_cell = cell;
+				return true;
+			}
+		}
+	}
+}
+
+void TileMap3DPathfinder::_expand(int p_node) {
+	Vector3i cell = nodes[p_node].cell;
+	real_t g = nodes[p_node].g;
+	int back = nodes[p_node].step >= 0 ? nodes[p_node].step ^ 1 : -1;
+	real_t cell_cost = reverse ? grid->get_cell_cost(cell) : 0.0;
+	for (int i = 0; i < step_count; i++) {
+		if (i == back) {
+			continue;
+		}
+		if (jump) {
+			Vector3i target;
+			if (_jump(cell, i, target)) {
+				int distance = ABS((target - cell)[i >> 1]);
+				_relax(p_node, target, i, g + distance * step_lengths[i] * min_cost);
+			}
+		} else {
+			Vector3i target = cell + steps[i];
+			real_t cost = grid->get_cell_cost(target);
+			if (cost >= 0.0) {
+				_relax(p_node, target, i, g + step_lengths[i] * (reverse ? cell_cost : cost));
+			}
+		}
+	}
+}
+
+void TileMap3DPathfinder::_build_path(int p_node, LocalVector<Vector3i> &r_path) const {
+	LocalVector<int> points;
+	for (int i = p_node; i >= 0; i = nodes[i].parent) {
+		points.push_back(i);
+	}
+
+	// Jumps are straight lines, the cells they skipped are added back.
+	r_path.clear();
+	r_path.push_back(nodes[points[points.size() - 1]].cell);
+	for (int i = points.size() - 2; i >= 0; i--) {
+		const Node &node = nodes[points[i]];
+		const Vector3i &step = steps[node.step];
+		Vector3i cell = r_path[r_path.size() - 1];
+		while (cell != node.cell) {
+			cell += step;
+			r_path.push_back(cell);
+		}
+	}
+}
+
+bool TileMap3DPathfinder::find_path(const Grid &p_grid, const Vector3i &p_from, const Vector3i &p_to, real_t p_min_cost, bool p_uniform_cost, LocalVector<Vector3i> &r_path) {
+	ERR_FAIL_COND_V(step_count == 0, false);
+	ERR_FAIL_COND_V(p_min_cost <= 0.0, false);
+	r_path.clear();
+	grid = &p_grid;
+	goal = p_to;
+	min_cost = p_min_cost;
+	jump = p_uniform_cost && !hexagonal;
+	reverse = false;
+	nodes.clear();
+	node_map.clear();
+	open.clear();
+	if (!_is_walkable(p_from) || !_is_walkable(p_to)) {
+		return false;
+	}
+
+	_relax(-1, p_from, -1, 0.0);
+	bool found = false;
+	while (!open.is_empty()) {
+		OpenEntry entry = _open_pop(open);
+		Node &node = nodes[entry.node];
+		if (node.closed || entry.g > node.g) {
+			continue; // Outdated entry.
+		}
+		node.closed = true;
+		if (node.cell == goal) {
+			found = true;
+			break;
+		}
+		_expand(entry.node);
+	}
+
+	if (found) {
+		_build_path(_get_node(goal), r_path);
+	}
+	grid = nullptr;
+	return found;
+}
+
+void TileMap3DPathfinder::find_costs(const Grid &p_grid, const Vector3i &p_from, const LocalVector<Vector3i> &p_targets, bool p_reverse, LocalVector<real_t> &r_costs) {
+	r_costs.resize(p_targets.size());
+	for (uint32_t i = 0; i < p_targets.size(); i++) {
+		r_costs[i] = -1.0;
+	}
+	ERR_FAIL_COND(step_count == 0);
+	grid = &p_grid;
+	goal = p_from;
+	min_cost = 0.0;
+	jump = false;
+	reverse = p_reverse;
+	nodes.clear();
+	node_map.clear();
+	open.clear();
+	if (!_is_walkable(p_from)) {
+		grid = nullptr;
+		return;
+	}
+
+	// Several targets may share a cell.
+	HashMap<uint64_t, int> pending;
+	int remaining = p_targets.size();
+	for (uint32_t i = 0; i < p_targets.size(); i++) {
+		uint64_t key = get_cell_key(p_targets[i]);
+		int *P = pending.getptr(key);
+		if (P) {
+			(*P)++;
+		} else {
+			pending.set(key, 1);
+		}
+	}
+
+	_relax(-1, p_from, -1, 0.0);
+	while (!open.is_empty() && remaining > 0) {
+		OpenEntry entry = _open_pop(open);
+		Node &node = nodes[entry.node];
+		if (node.closed || entry.g > node.g) {
+			continue;
+		}
+		node.closed = true;
+		int *P = pending.getptr(get_cell_key(node.cell));
+		if (P) {
+			remaining -= *P;
+			*P = 0;
+		}
+		_expand(entry.node);
+	}
+
+	for (uint32_t i = 0; i < p_targets.size(); i++) {
+		int *N = node_map.getptr(get_cell_key(p_targets[i]));
+		if (N && nodes[*N].closed) {
+			r_costs[i] = nodes[*N].g;
+		}
+	}
+	grid = nullptr;
+	reverse = false;
+}
+
+class TileMap3DPathGraph::BoundedGrid : public TileMap3DPathfinder::Grid {
+public:
+	const ClusterGrid *grid = nullptr;
+	uint64_t cluster = 0;
+
+	virtual real_t get_cell_cost(const Vector3i &p_cell) const override {
+		return grid->get_cell_cluster(p_cell) == cluster ? grid->get_cell_cost(p_cell) : -1.0;
+	}
+};
+
+void TileMap3DPathGraph::invalidate_cluster(uint64_t p_cluster) {
+	Map<uint64_t, Cluster>::Element *C = clusters.find(p_cluster);
+	if (C) {
+		C->get().dirty = true;
+	}
+}
+
+void TileMap3DPathGraph::clear() {
+	clusters.clear();
+}
+
+TileMap3DPathGraph::Cluster &TileMap3DPathGraph::_get_cluster(uint64_t p_cluster) {
+	Map<uint64_t, Cluster>::Element *C = clusters.find(p_cluster);
+	if (!C) {
+		C = clusters.insert(p_cluster, Cluster());
+	}
+	if (C->get().dirty) {
+		_build_cluster(p_cluster, C->get());
+	}
+	return C->get();
+}
+
+void TileMap3DPathGraph::_build_cluster(uint64_t p_cluster, Cluster &r_cluster) {
+	r_cluster.portals.clear();
+	r_cluster.version++;
+	r_cluster.dirty = false;
+
+	LocalVector<Vector3i> cells;
+	grid->get_cluster_cells(p_cluster, cells);
+
+	struct Transition {
+		Vector3i cell;
+		Vector3i other;
+		uint64_t other_cluster = 0;
+		real_t cost = 0.0;
+		int step = 0;
+		int root = 0;
+	};
+
+	// Every walkable neighbor pair across the border, looked up by step and
+	// cell.
+	LocalVector<Transition> transitions;
+	LocalVector<HashMap<uint64_t, int>> step_transitions;
+	step_transitions.resize(pathfinder->get_step_count());
+	HashMap<uint64_t, bool> visited;
+	for (uint32_t i = 0; i < cells.size(); i++) {
+		uint64_t key = TileMap3DPathfinder::get_cell_key(cells[i]);
+		if (visited.has(key)) {
+			continue;
+		}
+		visited.set(key, true);
+		if (grid->get_cell_cost(cells[i]) < 0.0) {
+			continue;
+		}
+		for (int j = 0; j < pathfinder->get_step_count(); j++) {
+			Transition t;
+			t.other = cells[i] + pathfinder->get_step(j);
+			t.other_cluster = grid->get_cell_cluster(t.other);
+			if (t.other_cluster == p_cluster) {
+				continue;
+			}
+			real_t cost = grid->get_cell_cost(t.other);
+			if (cost < 0.0) {
+				continue;
+			}
+			t.cell = cells[i];
+			t.cost = pathfinder->get_step_length(j) * cost;
+			t.step = j;
+			t.root = transitions.size();
+			step_transitions[j].set(key, t.root);
+			transitions.push_back(t);
+		}
+	}
+
+	// Transitions along the same step into the same cluster from neighbor
+	// cells belong to the same entrance, so any of them is reachable from any
+	// other on both sides. The relation reads the same from the other side
+	// and both clusters agree on the entrances.
+	auto find_root = [&](int p_idx) {
+		while (transitions[p_idx].root != p_idx) {
+			transitions[p_idx].root = transitions[transitions[p_idx].root].root;
+			p_idx = transitions[p_idx].root;
+		}
+		return p_idx;
+	};
+	for (uint32_t i = 0; i < transitions.size(); i++) {
+		const Transition &t = transitions[i];
+		for (int j = 0; j < pathfinder->get_step_count(); j++) {
+			const int *N = step_transitions[t.step].getptr(TileMap3DPathfinder::get_cell_key(t.cell + pathfinder->get_step(j)));
+			if (!N || transitions[*N].other_cluster != t.other_cluster) {
+				continue;
+			}
+			int ra = find_root(i);
+			int rb = find_root(*N);
+			if (ra != rb) {
+				transitions[MAX(ra, rb)].root = MIN(ra, rb);
+			}
+		}
+	}
+
+	// The portal pair of an entrance is the one nearest to its middle. Ties
+	// are broken by the keys of both cells so the other side picks the same.
+	struct Entrance {
+		Vector3i sum;
+		int count = 0;
+		int best = -1;
+		int64_t best_distance = 0;
+	};
+	LocalVector<Entrance> entrances;
+	entrances.resize(transitions.size());
+	for (uint32_t i = 0; i < transitions.size(); i++) {
+		Entrance &e = entrances[find_root(i)];
+		e.sum += transitions[i].cell + transitions[i].other;
+		e.count++;
+	}
+	for (uint32_t i = 0; i < transitions.size(); i++) {
+		const Transition &t = transitions[i];
+		Entrance &e = entrances[find_root(i)];
+		Vector3i d = (t.cell + t.other) * e.count - e.sum;
+		int64_t distance = int64_t(d.x) * d.x + int64_t(d.y) * d.y + int64_t(d.z) * d.z;
+		bool better = e.best < 0 || distance < e.best_distance;
+		if (!better && distance == e.best_distance) {
+			const Transition &b = transitions[e.best];
+			uint64_t tk[2] = { TileMap3DPathfinder::get_cell_key(t.cell), TileMap3DPathfinder::get_cell_key(t.other) };
+			uint64_t bk[2] = { TileMap3DPathfinder::get_cell_key(b.cell), TileMap3DPathfinder::get_cell_key(b.other) };
+			uint64_t t_min = MIN(tk[0], tk[1]);
+			uint64_t b_min = MIN(bk[0], bk[1]);
+			better = t_min == b_min ? MAX(tk[0], tk[1]) < MAX(bk[0], bk[1]) : t_min < b_min;
+		}
+		if (better) {
+			e.best = i;
+			e.best_distance = distance;
+		}
+	}
+	for (uint32_t i = 0; i < transitions.size(); i++) {
+		if (transitions[i].root != (int)i) {
+			continue;
+		}
+		const Transition &t = transitions[entrances[i].best];
+		Portal portal;
+		portal.cell = t.cell;
+		portal.other = t.other;
+		portal.cross_cost = t.cost;
+		r_cluster.portals.push_back(portal);
+	}
+
+	BoundedGrid bounded;
+	bounded.grid = grid;
+	bounded.cluster = p_cluster;
+	LocalVector<Vector3i> targets;
+	for (uint32_t i = 0; i < r_cluster.portals.size(); i++) {
+		targets.push_back(r_cluster.portals[i].cell);
+	}
+	for (uint32_t i = 0; i < r_cluster.portals.size(); i++) {
+		pathfinder->find_costs(bounded, targets[i], targets, false, r_cluster.portals[i].costs);
+	}
+}
+
+void TileMap3DPathGraph::_relax(int p_parent, int p_node, real_t p_g) {
+	Node &node = nodes[p_node];
+	if (node.closed || p_g >= node.g) {
+		return;
+	}
+	node.g = p_g;
+	node.parent = p_parent;
+
+	OpenEntry entry;
+	entry.f = p_g + pathfinder->get_distance(node.cell, goal) * min_cost;
+	entry.g = p_g;
+	entry.node = p_node;
+	_open_push(open, entry);
+}
+
+void TileMap3DPathGraph::_relax_portal(int p_parent, uint64_t p_cluster, Cluster &p_owner, int p_portal, real_t p_g) {
+	Portal &portal = p_owner.portals[p_portal];
+	if (portal.query != last_query) {
+		Node node;
+		node.cell = portal.cell;
+		node.cluster = p_cluster;
+		node.owner = &p_owner;
+		node.portal = &portal;
+		node.portal_index = p_portal;
+		node.g = Math_INF;
+		nodes.push_back(node);
+		portal.node = nodes.size() - 1;
+		portal.query = last_query;
+	}
+	_relax(p_parent, portal.node, p_g);
+}
+
+bool TileMap3DPathGraph::_refine(int p_goal_node, bool p_uniform_cost, LocalVector<Vector3i> &r_path) {
+	LocalVector<int> points;
+	for (int i = p_goal_node; i >= 0; i = nodes[i].parent) {
+		points.push_back(i);
+	}
+
+	// Consecutive nodes are either on both sides of a border or in the same
+	// cluster, where a bounded search walks between them.
+	BoundedGrid bounded;
+	bounded.grid = grid;
+	LocalVector<Vector3i> leg;
+	r_path.clear();
+	r_path.push_back(nodes[0].cell);
+	for (int i = points.size() - 2; i >= 0; i--) {
+		const Node &from = nodes[points[i + 1]];
+		const Node &to = nodes[points[i]];
+		const Vector3i &cell = to.cell;
+		if (from.cluster != to.cluster) {
+			r_path.push_back(cell);
+			continue;
+		}
+		bounded.cluster = to.cluster;
+		if (!pathfinder->find_path(bounded, r_path[r_path.size() - 1], cell, min_cost, p_uniform_cost, leg)) {
+			r_path.clear();
+			return false;
+		}
+		for (uint32_t j = 1; j < leg.size(); j++) {
+			r_path.push_back(leg[j]);
+		}
+	}
+	return true;
+}
+
+bool TileMap3DPathGraph::find_path(TileMap3DPathfinder &p_pathfinder, const ClusterGrid &p_grid, const Vector3i &p_from, const Vector3i &p_to, real_t p_min_cost, bool p_uniform_cost, LocalVector<Vector3i> &r_path) {
+	ERR_FAIL_COND_V(p_pathfinder.get_step_count() == 0, false);
+	ERR_FAIL_COND_V(p_min_cost <= 0.0, false);
+	r_path.clear();
+	uint64_t from_cluster = p_grid.get_cell_cluster(p_from);
+	uint64_t to_cluster = p_grid.get_cell_cluster(p_to);
+	if (from_cluster == to_cluster) {
+		return p_pathfinder.find_path(p_grid, p_from, p_to, p_min_cost, p_uniform_cost, r_path);
+	}
+	if (p_grid.get_cell_cost(p_from) < 0.0 || p_grid.get_cell_cost(p_to) < 0.0) {
+		return false;
+	}
+
+	pathfinder = &p_pathfinder;
+	grid = &p_grid;
+	goal = p_to;
+	min_cost = p_min_cost;
+	last_query++;
+	nodes.clear();
+	open.clear();
+
+	// The start and goal cells are linked to the portals of their clusters
+	// for this query only.
+	BoundedGrid bounded;
+	bounded.grid = grid;
+	LocalVector<Vector3i> targets;
+	LocalVector<real_t> start_costs;
+	LocalVector<real_t> goal_costs;
+	Cluster &first = _get_cluster(from_cluster);
+	for (uint32_t i = 0; i < first.portals.size(); i++) {
+		targets.push_back(first.portals[i].cell);
+	}
+	bounded.cluster = from_cluster;
+	pathfinder->find_costs(bounded, p_from, targets, false, start_costs);
+	Cluster &last = _get_cluster(to_cluster);
+	targets.clear();
+	for (uint32_t i = 0; i < last.portals.size(); i++) {
+		targets.push_back(last.portals[i].cell);
+	}
+	bounded.cluster = to_cluster;
+	pathfinder->find_costs(bounded, p_to, targets, true, goal_costs);
+
+	Node node;
+	node.cell = p_from;
+	node.cluster = from_cluster;
+	nodes.push_back(node);
+	node.cell = p_to;
+	node.cluster = to_cluster;
+	node.g = Math_INF;
+	nodes.push_back(node);
+	OpenEntry entry;
+	entry.f = pathfinder->get_distance(p_from, p_to) * min_cost;
+	_open_push(open, entry);
+
+	bool found = false;
+	while (!open.is_empty()) {
+		entry = _open_pop(open);
+		if (nodes[entry.node].closed || entry.g > nodes[entry.node].g) {
+			continue;
+		}
+		nodes[entry.node].closed = true;
+		if (entry.node == 1) {
+			found = true;
+			break;
+		}
+		if (entry.node == 0) {
+			for (uint32_t i = 0; i < start_costs.size(); i++) {
+				if (start_costs[i] >= 0.0) {
+					_relax_portal(0, from_cluster, first, i, start_costs[i]);
+				}
+			}
+			continue;
+		}
+
+		uint64_t cluster = nodes[entry.node].cluster;
+		Portal &portal = *nodes[entry.node].portal;
+		int idx = nodes[entry.node].portal_index;
+		real_t g = nodes[entry.node].g;
+		Cluster &owner = *nodes[entry.node].owner;
+		if (cluster == to_cluster && goal_costs[idx] >= 0.0) {
+			_relax(entry.node, 1, g + goal_costs[idx]);
+		}
+		for (uint32_t i = 0; i < portal.costs.size(); i++) {
+			if ((int)i != idx && portal.costs[i] >= 0.0) {
+				_relax_portal(entry.node, cluster, owner, i, g + portal.costs[i]);
+			}
+		}
+
+		// The other side is built on demand, both sides pick the same pair.
+		if (!portal.link || portal.link->dirty || portal.link->version != portal.link_version) {
+			portal.link_cluster = grid->get_cell_cluster(portal.other);
+			portal.link = &_get_cluster(portal.link_cluster);
+			portal.link_version = portal.link->version;
+			portal.link_portal = -1;
+			for (uint32_t i = 0; i < portal.link->portals.size(); i++) {
+				const Portal &other = portal.link->portals[i];
+				if (other.cell == portal.other && other.other == portal.cell) {
+					portal.link_portal = i;
+					break;
+				}
+			}
+		}
+		if (portal.link_portal >= 0) {
+			_relax_portal(entry.node, portal.link_cluster, *portal.link, portal.link_portal, g + portal.cross_cost);
+		}
+	}
+
+	if (found) {
+		found = _refine(1, p_uniform_cost, r_path);
+	}
+	pathfinder = nullptr;
+	grid = nullptr;
+	return found;
+}
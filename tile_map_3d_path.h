@@ -0,0 +1,220 @@
+/*************************************************************************/
+/*  tile_map_3d_path.h                                                   */
+/*************************************************************************/
+/*                       This file is part of:                           */
+/*                           GODOT ENGINE                                */
+/*                      https://godotengine.org                          */
+/*************************************************************************/
+/* Copyright (c) 2007-2021 Juan Linietsky, Ariel Manzur.                 */
+/* Copyright (c) 2014-2021 Godot Engine contributors (cf. AUTHORS.md).   */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#ifndef TILE_MAP_3D_PATH_H
+#define TILE_MAP_3D_PATH_H
+
+#include "core/math/basis.h"
+#include "core/math/vector3i.h"
+#include "core/templates/hash_map.h"
+#include "core/templates/local_vector.h"
+#include "core/templates/map.h"
+
+// A* over the cells of a lattice described the same way as in TileMap3D.
+// Cuboid lattices where every cell costs the same use jump point search.
+class TileMap3DPathfinder {
+public:
+	// The map as seen by the searches.
+	class Grid {
+	public:
+		// Cost of entering the cell, negative if it can not be entered.
+		virtual real_t get_cell_cost(const Vector3i &p_cell) const = 0;
+		virtual ~Grid() {}
+	};
+
+private:
+	static const int MAX_STEPS = 8;
+
+	struct Node {
+		Vector3i cell;
+		real_t g = 0.0;
+		int parent = -1;
+		int step = -1; // Step that led to the cell, -1 for the start.
+		bool closed = false;
+	};
+
+	struct OpenEntry {
+		real_t f = 0.0;
+		real_t g = 0.0;
+		int node = 0;
+
+		// Lowest f first, then the deepest node.
+		_FORCE_INLINE_ bool operator<(const OpenEntry &p_entry) const {
+			return f == p_entry.f ? g > p_entry.g : f < p_entry.f;
+		}
+	};
+
+	// Steps come in opposite pairs, step i ^ 1 undoes step i. Cuboid
+	// lattices have one pair per lattice axis, in axis order. Hexagonal ones
+	// have the main axis pair, one pair per plane axis and the plane diagonal.
+	Vector3i steps[MAX_STEPS];
+	real_t step_lengths[MAX_STEPS];
+	int step_count = 0;
+	bool hexagonal = false;
+	int main_axis = 1;
+	int plane_axes[2] = { 2, 0 };
+	int diagonal_sign = 1; // The plane diagonal is plane_axes[0] + diagonal_sign * plane_axes[1].
+
+	const Grid *grid = nullptr;
+	Vector3i goal;
+	real_t min_cost = 1.0; // Zero turns the searches into Dijkstra ones.
+	bool jump = false;
+	bool reverse = false; // Moves are walked backwards, paying for the cell left.
+	LocalVector<Node> nodes;
+	HashMap<uint64_t, int> node_map;
+	LocalVector<OpenEntry> open;
+
+	_FORCE_INLINE_ bool _is_walkable(const Vector3i &p_cell) const { return grid->get_cell_cost(p_cell) >= 0.0; }
+
+	real_t _heuristic(const Vector3i &p_cell) const;
+	int _get_node(const Vector3i &p_cell);
+	void _relax(int p_parent, const Vector3i &p_cell, int p_step, real_t p_g);
+	bool _jump(const Vector3i &p_from, int p_step, Vector3i &r_cell) const;
+	void _expand(int p_node);
+	void _build_path(int p_node, LocalVector<Vector3i> &r_path) const;
+
+public:
+	static _FORCE_INLINE_ uint64_t get_cell_key(const Vector3i &p_cell) {
+		return (uint64_t(p_cell.x) & 0x1FFFFF) | ((uint64_t(p_cell.y) & 0x1FFFFF) << 21) | ((uint64_t(p_cell.z) & 0x1FFFFF) << 42);
+	}
+
+	// p_cell_basis rows are the lattice vectors, like TileMap3D::cell_basis.
+	void set_lattice(bool p_hexagonal, int p_main_axis, const Basis &p_cell_basis);
+	// Finds the cheapest path between two cells, both included. Moving costs
+	// the distance between cell centers times the cost of the cell entered,
+	// which must be at least p_min_cost. p_uniform_cost tells every
+	// enterable cell costs exactly p_min_cost.
+	bool find_path(const Grid &p_grid, const Vector3i &p_from, const Vector3i &p_to, real_t p_min_cost, bool p_uniform_cost, LocalVector<Vector3i> &r_path);
+	// Costs of the cheapest paths from p_from to each target, negative for
+	// the unreachable ones. With p_reverse they are the costs of the paths
+	// from each target to p_from instead.
+	void find_costs(const Grid &p_grid, const Vector3i &p_from, const LocalVector<Vector3i> &p_targets, bool p_reverse, LocalVector<real_t> &r_costs);
+
+	int get_step_count() const { return step_count; }
+	const Vector3i &get_step(int p_step) const { return steps[p_step]; }
+	real_t get_step_length(int p_step) const { return step_lengths[p_step]; }
+	// Length of the shortest lattice walk between two cells, ignoring the
+	// cells in between.
+	real_t get_distance(const Vector3i &p_from, const Vector3i &p_to) const;
+};
+
+// Hierarchical A* over clusters of cells. The abstract graph links portals,
+// walkable cells next to a walkable cell of another cluster, and caches the
+// costs between the portals of each cluster. Queries search that graph first
+// and then refine every leg with a search bounded to one cluster, so paths
+// may be slightly longer than the cheapest ones.
+class TileMap3DPathGraph {
+public:
+	class ClusterGrid : public TileMap3DPathfinder::Grid {
+	public:
+		virtual uint64_t get_cell_cluster(const Vector3i &p_cell) const = 0;
+		// Cells of the cluster that may be entered, repeated ones allowed.
+		virtual void get_cluster_cells(uint64_t p_cluster, LocalVector<Vector3i> &r_cells) const = 0;
+	};
+
+private:
+	class BoundedGrid;
+
+	struct Cluster;
+
+	// Each entrance between two clusters, a connected run of walkable
+	// neighbor pairs across their border, gets one portal on each side.
+	struct Portal {
+		Vector3i cell;
+		Vector3i other; // Across the border, portal cell of the other cluster.
+		real_t cross_cost = 0.0; // Moving from cell to other.
+		LocalVector<real_t> costs; // To each portal of the cluster, negative when unreachable.
+		// Portal of the other side, valid while that cluster keeps its version.
+		Cluster *link = nullptr;
+		uint64_t link_cluster = 0;
+		uint32_t link_version = 0;
+		int link_portal = -1;
+		// Search node of the portal, valid during the query it was made in.
+		int node = -1;
+		uint32_t query = 0;
+	};
+
+	struct Cluster {
+		LocalVector<Portal> portals;
+		uint32_t version = 0;
+		bool dirty = true;
+	};
+
+	// The first two nodes of a query are its start and goal cells. Clusters
+	// are not rebuilt while a query runs, so portal pointers stay valid.
+	struct Node {
+		Vector3i cell;
+		uint64_t cluster = 0;
+		Cluster *owner = nullptr;
+		Portal *portal = nullptr;
+		int portal_index = -1;
+		real_t g = 0.0;
+		int parent = -1;
+		bool closed = false;
+	};
+
+	struct OpenEntry {
+		real_t f = 0.0;
+		real_t g = 0.0;
+		int node = 0;
+
+		_FORCE_INLINE_ bool operator<(const OpenEntry &p_entry) const {
+			return f == p_entry.f ? g > p_entry.g : f < p_entry.f;
+		}
+	};
+
+	Map<uint64_t, Cluster> clusters;
+
+	TileMap3DPathfinder *pathfinder = nullptr;
+	const ClusterGrid *grid = nullptr;
+	Vector3i goal;
+	real_t min_cost = 1.0;
+	uint32_t last_query = 0;
+	LocalVector<Node> nodes;
+	LocalVector<OpenEntry> open;
+
+	Cluster &_get_cluster(uint64_t p_cluster);
+	void _build_cluster(uint64_t p_cluster, Cluster &r_cluster);
+	void _relax(int p_parent, int p_node, real_t p_g);
+	void _relax_portal(int p_parent, uint64_t p_cluster, Cluster &p_owner, int p_portal, real_t p_g);
+	bool _refine(int p_goal_node, bool p_uniform_cost, LocalVector<Vector3i> &r_path);
+
+public:
+	// Cached portals and costs of the cluster are rebuilt on the next query
+	// reaching it. Editing a cell invalidates its cluster and the clusters of
+	// its neighbors.
+	void invalidate_cluster(uint64_t p_cluster);
+	void clear();
+	// Same as TileMap3DPathfinder::find_path(), p_pathfinder must have its
+	// lattice set already. Paths within one cluster are searched directly.
+	bool find_path(TileMap3DPathfinder &p_pathfinder, const ClusterGrid &p_grid, const Vector3i &p_from, const Vector3i &p_to, real_t p_min_cost, bool p_uniform_cost, LocalVector<Vector3i> &r_path);
+};
+
+#endif // TILE_MAP_3D_PATH_H
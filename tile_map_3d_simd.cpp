@@ -0,0 +1,152 @@
+/*************************************************************************/
+/*  tile_map_3d_simd.cpp                                                 */
+/*************************************************************************/
+/*                       This file is part of:                           */
+/*                           GODOT ENGINE                                */
+/*                      https://godotengine.org                          */
+/*************************************************************************/
+/* Copyright (c) 2007-2021 Juan Linietsky, Ariel Manzur.                 */
+/* Copyright (c) 2014-2021 Godot Engine contributors (cf. AUTHORS.md).   */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#include "tile_map_3d_simd.h"
+
+#include "core/math/math_funcs.h"
+
+// The SSE2 path is only used with single precision, where Vector3 is three
+// packed floats. Four cells are read at once with three loads and
+// transposed to one register per component.
+#if !defined(REAL_T_IS_DOUBLE) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define TILE_MAP_3D_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef TILE_MAP_3D_SSE2
+
+// (x0 y0 z0 x1) (y1 z1 x2 y2) (z2 x3 y3 z3) -> (x0 x1 x2 x3) (y0 y1 y2 y3) (z0 z1 z2 z3)
+static _FORCE_INLINE_ void _aos_to_soa(__m128 p_a, __m128 p_b, __m128 p_c, __m128 &r_x, __m128 &r_y, __m128 &r_z) {
+	r_x = _mm_shuffle_ps(p_a, _mm_shuffle_ps(p_b, p_c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+	r_y = _mm_shuffle_ps(_mm_shuffle_ps(p_a, p_b, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(p_b, p_c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+	r_z = _mm_shuffle_ps(_mm_shuffle_ps(p_a, p_b, _MM_SHUFFLE(1, 1, 2, 2)), _mm_shuffle_ps(p_c, p_c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+// Inverse of _aos_to_soa().
+static _FORCE_INLINE_ void _soa_to_aos(__m128 p_x, __m128 p_y, __m128 p_z, __m128 &r_a, __m128 &r_b, __m128 &r_c) {
+	r_a = _mm_shuffle_ps(_mm_shuffle_ps(p_x, p_y, _MM_SHUFFLE(0, 0, 0, 0)), _mm_shuffle_ps(p_z, p_x, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+	r_b = _mm_shuffle_ps(_mm_shuffle_ps(p_y, p_z, _MM_SHUFFLE(1, 1, 1, 1)), _mm_shuffle_ps(p_x, p_y, _MM_SHUFFLE(2, 2, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0));
+	r_c = _mm_shuffle_ps(_mm_shuffle_ps(p_z, p_x, _MM_SHUFFLE(3, 3, 2, 2)), _mm_shuffle_ps(p_y, p_z, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+// r = m0 * x + m1 * y + m2 * z + o, one output component per call.
+static _FORCE_INLINE_ __m128 _madd3(float p_m0, float p_m1, float p_m2, float p_o, __m128 p_x, __m128 p_y, __m128 p_z) {
+	__m128 r = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(p_m0), p_x), _mm_set1_ps(p_o));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(p_m1), p_y));
+	return _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(p_m2), p_z));
+}
+
+// floor(v + 0.5) without SSE4.1.
+static _FORCE_INLINE_ __m128i _round_ps(__m128 p_v) {
+	__m128 v = _mm_add_ps(p_v, _mm_set1_ps(0.5f));
+	__m128i t = _mm_cvttps_epi32(v);
+	// Truncation rounds negative values up, subtract one where that happened.
+	__m128 over = _mm_cmpgt_ps(_mm_cvtepi32_ps(t), v);
+	return _mm_add_epi32(t, _mm_castps_si128(over));
+}
+
+#endif // TILE_MAP_3D_SSE2
+
+void TileMap3DSIMD::cells_to_local(const Basis &p_basis, const Vector3 &p_offset, const Vector3i *p_cells, Vector3 *r_points, int p_count) {
+	int i = 0;
+#ifdef TILE_MAP_3D_SSE2
+	const Basis &b = p_basis;
+	for (; i + 4 <= p_count; i += 4) {
+		const __m128i *src = (const __m128i *)(p_cells + i);
+		__m128 x, y, z;
+		_aos_to_soa(_mm_castsi128_ps(_mm_loadu_si128(src)), _mm_castsi128_ps(_mm_loadu_si128(src + 1)), _mm_castsi128_ps(_mm_loadu_si128(src + 2)), x, y, z);
+		x = _mm_cvtepi32_ps(_mm_castps_si128(x));
+		y = _mm_cvtepi32_ps(_mm_castps_si128(y));
+		z = _mm_cvtepi32_ps(_mm_castps_si128(z));
+
+		__m128 px = _madd3(b[0].x, b[1].x, b[2].x, p_offset.x, x, y, z);
+		__m128 py = _madd3(b[0].y, b[1].y, b[2].y, p_offset.y, x, y, z);
+		__m128 pz = _madd3(b[0].z, b[1].z, b[2].z, p_offset.z, x, y, z);
+
+		__m128 a, c, d;
+		_soa_to_aos(px, py, pz, a, c, d);
+		float *dst = (float *)(r_points + i);
+		_mm_storeu_ps(dst, a);
+		_mm_storeu_ps(dst + 4, c);
+		_mm_storeu_ps(dst + 8, d);
+	}
+#endif
+	for (; i < p_count; i++) {
+		const Vector3i &c = p_cells[i];
+		r_points[i] = p_basis[0] * c.x + p_basis[1] * c.y + p_basis[2] * c.z + p_offset;
+	}
+}
+
+void TileMap3DSIMD::local_to_coords(const Basis &p_inverse, const Vector3 &p_offset, const Vector3 *p_points, Vector3 *r_coords, int p_count) {
+	int i = 0;
+#ifdef TILE_MAP_3D_SSE2
+	const Basis &m = p_inverse;
+	// Fold the offset into the constant term: m * (p - o) = m * p - m * o.
+	Vector3 o = -m.xform(p_offset);
+	for (; i + 4 <= p_count; i += 4) {
+		const float *src = (const float *)(p_points + i);
+		__m128 x, y, z;
+		_aos_to_soa(_mm_loadu_ps(src), _mm_loadu_ps(src + 4), _mm_loadu_ps(src + 8), x, y, z);
+
+		__m128 cx = _madd3(m[0].x, m[0].y, m[0].z, o.x, x, y, z);
+		__m128 cy = _madd3(m[1].x, m[1].y, m[1].z, o.y, x, y, z);
+		__m128 cz = _madd3(m[2].x, m[2].y, m[2].z, o.z, x, y, z);
+
+		__m128 a, b, c;
+		_soa_to_aos(cx, cy, cz, a, b, c);
+		float *dst = (float *)(r_coords + i);
+		_mm_storeu_ps(dst, a);
+		_mm_storeu_ps(dst + 4, b);
+		_mm_storeu_ps(dst + 8, c);
+	}
+#endif
+	for (; i < p_count; i++) {
+		r_coords[i] = p_inverse.xform(p_points[i] - p_offset);
+	}
+}
+
+void TileMap3DSIMD::round_coords(const Vector3 *p_coords, Vector3i *r_cells, int p_count) {
+	int i = 0;
+#ifdef TILE_MAP_3D_SSE2
+	// Rounding is per component, so the data does not need to be transposed.
+	const float *src = (const float *)p_coords;
+	int32_t *dst = (int32_t *)r_cells;
+	for (; i + 4 <= p_count; i += 4) {
+		int k = i * 3;
+		_mm_storeu_si128((__m128i *)(dst + k), _round_ps(_mm_loadu_ps(src + k)));
+		_mm_storeu_si128((__m128i *)(dst + k + 4), _round_ps(_mm_loadu_ps(src + k + 4)));
+		_mm_storeu_si128((__m128i *)(dst + k + 8), _round_ps(_mm_loadu_ps(src + k + 8)));
+	}
+#endif
+	for (; i < p_count; i++) {
+		const Vector3 &c = p_coords[i];
+		r_cells[i] = Vector3i(Math::floor(c.x + 0.5), Math::floor(c.y + 0.5), Math::floor(c.z + 0.5));
+	}
+}
@@ -0,0 +1,51 @@
+/*************************************************************************/
+/*  tile_map_3d_simd.h                                                   */
+/*************************************************************************/
+/*                       This file is part of:                           */
+/*                           GODOT ENGINE                                */
+/*                      https://godotengine.org                          */
+/*************************************************************************/
+/* Copyright (c) 2007-2021 Juan Linietsky, Ariel Manzur.                 */
+/* Copyright (c) 2014-2021 Godot Engine contributors (cf. AUTHORS.md).   */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#ifndef TILE_MAP_3D_SIMD_H
+#define TILE_MAP_3D_SIMD_H
+
+#include "core/math/basis.h"
+#include "core/math/vector3.h"
+#include "core/math/vector3i.h"
+
+// Batch kernels converting between cell coordinates and local positions.
+// A lattice is described the same way as in TileMap3D: a position is
+// basis[0] * x + basis[1] * y + basis[2] * z + offset.
+class TileMap3DSIMD {
+public:
+	static void cells_to_local(const Basis &p_basis, const Vector3 &p_offset, const Vector3i *p_cells, Vector3 *r_points, int p_count);
+	// Writes the fractional lattice coordinates of each point. p_inverse maps
+	// (point - offset) to lattice coordinates.
+	static void local_to_coords(const Basis &p_inverse, const Vector3 &p_offset, const Vector3 *p_points, Vector3 *r_coords, int p_count);
+	// Rounds lattice coordinates to the nearest integer cell.
+	static void round_coords(const Vector3 *p_coords, Vector3i *r_cells, int p_count);
+};
+
+#endif // TILE_MAP_3D_SIMD_H
@@ -78,6 +78,34 @@ void TileData3D::set_source(const String &p_source) {
 	source = p_source;
 }
 
+void TileData3D::set_opaque_full_cell(bool p_opaque) {
+	opaque_full_cell = p_opaque;
+	_queue_changed();
+}
+
+bool TileData3D::is_opaque_full_cell() const {
+	return opaque_full_cell;
+}
+
+void TileData3D::set_walkable(bool p_walkable) {
+	walkable = p_walkable;
+	_queue_changed();
+}
+
+bool TileData3D::is_walkable() const {
+	return walkable;
+}
+
+void TileData3D::set_walk_cost(float p_cost) {
+	ERR_FAIL_COND_MSG(p_cost <= 0.0, "Walk cost must be greater than 0.");
+	walk_cost = p_cost;
+	_queue_changed();
+}
+
+float TileData3D::get_walk_cost() const {
+	return walk_cost;
+}
+
 String TileData3D::get_source() const {
 	return source;
 }
@@ -145,10 +173,22 @@ void TileData3D::_bind_methods() {
 	ClassDB::bind_method(D_METHOD("get_preview"), &TileData3D::get_preview);
 	ClassDB::bind_method(D_METHOD("set_probability", "probabilty"), &TileData3D::set_probability);
 	ClassDB::bind_method(D_METHOD("get_probability"), &TileData3D::get_probability);
+	ClassDB::bind_method(D_METHOD("set_opaque_full_cell", "opaque"), &TileData3D::set_opaque_full_cell);
+	ClassDB::bind_method(D_METHOD("is_opaque_full_cell"), &TileData3D::is_opaque_full_cell);
+	ClassDB::bind_method(D_METHOD("set_walkable", "walkable"), &TileData3D::set_walkable);
+	ClassDB::bind_method(D_METHOD("is_walkable"), &TileData3D::is_walkable);
+	ClassDB::bind_method(D_METHOD("set_walk_cost", "cost"), &TileData3D::set_walk_cost);
+	ClassDB::bind_method(D_METHOD("get_walk_cost"), &TileData3D::get_walk_cost);
 
 	ADD_PROPERTY(PropertyInfo(Variant::VECTOR3I, "span"), "set_span", "get_span");
 	ADD_PROPERTY(PropertyInfo(Variant::OBJECT, "preview", PROPERTY_HINT_RESOURCE_TYPE, "Texture2D"), "set_preview", "get_preview");
 	ADD_PROPERTY(PropertyInfo(Variant::FLOAT, "probability", PROPERTY_HINT_RANGE, "0,1,0.01"), "set_probability", "get_probability");
+	// Fills its whole cell and hides the faces of its neighbors.
+	ADD_PROPERTY(PropertyInfo(Variant::BOOL, "opaque_full_cell"), "set_opaque_full_cell", "is_opaque_full_cell");
+	// Cells can be part of TileMap3D cell paths, entering them costs walk_cost
+	// per unit of distance.
+	ADD_PROPERTY(PropertyInfo(Variant::BOOL, "walkable"), "set_walkable", "is_walkable");
+	ADD_PROPERTY(PropertyInfo(Variant::FLOAT, "walk_cost", PROPERTY_HINT_RANGE, "0.01,100,0.01,or_greater"), "set_walk_cost", "get_walk_cost");
 }
 
 /******* TileData3DMesh *******/
@@ -172,6 +212,15 @@ Transform3D TileData3DMesh::get_mesh_transform() const {
 	return mesh_transform;
 }
 
+void TileData3DMesh::set_shadow_mesh(const Ref<Mesh> &p_mesh) {
+	shadow_mesh = p_mesh;
+	_queue_changed();
+}
+
+Ref<Mesh> TileData3DMesh::get_shadow_mesh() const {
+	return shadow_mesh;
+}
+
 void TileData3DMesh::set_material_override(const Ref<Material> &p_material) {
 	material_override = p_material;
 	_queue_changed();
@@ -280,6 +329,24 @@ GeometryInstance3D::VisibilityRangeFadeMode TileData3DMesh::get_visibility_range
 	return visibility_range_fade_mode;
 }
 
+void TileData3DMesh::set_occlusion_vertices(const PackedVector3Array &p_vertices) {
+	occlusion_vertices = p_vertices;
+	_queue_changed();
+}
+
+PackedVector3Array TileData3DMesh::get_occlusion_vertices() const {
+	return occlusion_vertices;
+}
+
+void TileData3DMesh::set_occlusion_indices(const PackedInt32Array &p_indices) {
+	occlusion_indices = p_indices;
+	_queue_changed();
+}
+
+PackedInt32Array TileData3DMesh::get_occlusion_indices() const {
+	return occlusion_indices;
+}
+
 void TileData3DMesh::set_physics_data_count(int p_count) {
 	physics_data.resize(p_count);
 	_queue_changed();
@@ -481,6 +548,21 @@ Transform3D TileData3DMesh::get_navigation_data_navmesh_transform(int p_index) c
 	return navigation_data[p_index].local_transform;
 }
 
+void TileData3DMesh::set_light_count(int p_count) {
+	ERR_FAIL_COND(p_count < 0);
+	lights.resize(p_count);
+	_queue_changed();
+}
+
+int TileData3DMesh::get_light_count() const {
+	return lights.size();
+}
+
+const TileData3DMesh::LightTileData3D &TileData3DMesh::get_light(int p_index) const {
+	CRASH_BAD_INDEX(p_index, lights.size());
+	return lights[p_index];
+}
+
 void TileData3DMesh::set_light_transform(int p_index, const Transform3D &p_transform) {
 	ERR_FAIL_INDEX(p_index, lights.size());
 	lights.write[p_index].local_transform = p_transform;
@@ -860,6 +942,8 @@ void TileData3DMesh::_bind_methods() {
 	ClassDB::bind_method(D_METHOD("get_mesh"), &TileData3DMesh::get_mesh);
 	ClassDB::bind_method(D_METHOD("set_mesh_transform", "transform"), &TileData3DMesh::set_mesh_transform);
 	ClassDB::bind_method(D_METHOD("get_mesh_transform"), &TileData3DMesh::get_mesh_transform);
+	ClassDB::bind_method(D_METHOD("set_shadow_mesh", "mesh"), &TileData3DMesh::set_shadow_mesh);
+	ClassDB::bind_method(D_METHOD("get_shadow_mesh"), &TileData3DMesh::get_shadow_mesh);
 	ClassDB::bind_method(D_METHOD("set_material_override", "material"), &TileData3DMesh::set_material_override);
 	ClassDB::bind_method(D_METHOD("get_material_override"), &TileData3DMesh::get_material_override);
 	ClassDB::bind_method(D_METHOD("set_transparency", "transparency"), &TileData3DMesh::set_transparency);
@@ -887,6 +971,11 @@ void TileData3DMesh::_bind_methods() {
 	ClassDB::bind_method(D_METHOD("set_visibility_range_fade_mode", "mode"), &TileData3DMesh::set_visibility_range_fade_mode);
 	ClassDB::bind_method(D_METHOD("get_visibility_range_fade_mode"), &TileData3DMesh::get_visibility_range_fade_mode);
 
+	ClassDB::bind_method(D_METHOD("set_occlusion_vertices", "vertices"), &TileData3DMesh::set_occlusion_vertices);
+	ClassDB::bind_method(D_METHOD("get_occlusion_vertices"), &TileData3DMesh::get_occlusion_vertices);
+	ClassDB::bind_method(D_METHOD("set_occlusion_indices", "indices"), &TileData3DMesh::set_occlusion_indices);
+	ClassDB::bind_method(D_METHOD("get_occlusion_indices"), &TileData3DMesh::get_occlusion_indices);
+
 	ClassDB::bind_method(D_METHOD("set_physics_data_count", "count"), &TileData3DMesh::set_physics_data_count);
 	ClassDB::bind_method(D_METHOD("get_physics_data_count"), &TileData3DMesh::get_physics_data_count);
 	ClassDB::bind_method(D_METHOD("add_physics_data", "to_position"), &TileData3DMesh::add_physics_data, DEFVAL(-1));
@@ -896,9 +985,58 @@ void TileData3DMesh::_bind_methods() {
 	ClassDB::bind_method(D_METHOD("set_navigation_data_count", "count"), &TileData3DMesh::set_navigation_data_count);
 	ClassDB::bind_method(D_METHOD("get_navigation_data_count"), &TileData3DMesh::get_navigation_data_count);
 
+	ClassDB::bind_method(D_METHOD("set_light_count", "count"), &TileData3DMesh::set_light_count);
+	ClassDB::bind_method(D_METHOD("get_light_count"), &TileData3DMesh::get_light_count);
+	ClassDB::bind_method(D_METHOD("set_light_transform", "index", "transform"), &TileData3DMesh::set_light_transform);
+	ClassDB::bind_method(D_METHOD("get_light_transform", "index"), &TileData3DMesh::get_light_transform);
+	ClassDB::bind_method(D_METHOD("set_light_type", "index", "type"), &TileData3DMesh::set_light_type);
+	ClassDB::bind_method(D_METHOD("get_light_type", "index"), &TileData3DMesh::get_light_type);
+	ClassDB::bind_method(D_METHOD("set_light_range", "index", "range"), &TileData3DMesh::set_light_range);
+	ClassDB::bind_method(D_METHOD("get_light_range", "index"), &TileData3DMesh::get_light_range);
+	ClassDB::bind_method(D_METHOD("set_light_attenuation", "index", "attenuation"), &TileData3DMesh::set_light_attenuation);
+	ClassDB::bind_method(D_METHOD("get_light_attenuation", "index"), &TileData3DMesh::get_light_attenuation);
+	ClassDB::bind_method(D_METHOD("set_light_spot_angle", "index", "angle"), &TileData3DMesh::set_light_spot_angle);
+	ClassDB::bind_method(D_METHOD("get_light_spot_angle", "index"), &TileData3DMesh::get_light_spot_angle);
+	ClassDB::bind_method(D_METHOD("set_light_spot_angle_attenuation", "index", "angle_attenuation"), &TileData3DMesh::set_light_spot_angle_attenuation);
+	ClassDB::bind_method(D_METHOD("get_light_spot_angle_attenuation", "index"), &TileData3DMesh::get_light_spot_angle_attenuation);
+	ClassDB::bind_method(D_METHOD("set_light_omni_shadow_mode", "index", "mode"), &TileData3DMesh::set_light_omni_shadow_mode);
+	ClassDB::bind_method(D_METHOD("get_light_omni_shadow_mode", "index"), &TileData3DMesh::get_light_omni_shadow_mode);
+	ClassDB::bind_method(D_METHOD("set_light_color", "index", "color"), &TileData3DMesh::set_light_color);
+	ClassDB::bind_method(D_METHOD("get_light_color", "index"), &TileData3DMesh::get_light_color);
+	ClassDB::bind_method(D_METHOD("set_light_energy", "index", "energy"), &TileData3DMesh::set_light_energy);
+	ClassDB::bind_method(D_METHOD("get_light_energy", "index"), &TileData3DMesh::get_light_energy);
+	ClassDB::bind_method(D_METHOD("set_light_indirect_energy", "index", "energy"), &TileData3DMesh::set_light_indirect_energy);
+	ClassDB::bind_method(D_METHOD("get_light_indirect_energy", "index"), &TileData3DMesh::get_light_indirect_energy);
+	ClassDB::bind_method(D_METHOD("set_light_projector", "index", "projector"), &TileData3DMesh::set_light_projector);
+	ClassDB::bind_method(D_METHOD("get_light_projector", "index"), &TileData3DMesh::get_light_projector);
+	ClassDB::bind_method(D_METHOD("set_light_size", "index", "size"), &TileData3DMesh::set_light_size);
+	ClassDB::bind_method(D_METHOD("get_light_size", "index"), &TileData3DMesh::get_light_size);
+	ClassDB::bind_method(D_METHOD("set_light_negative", "index", "negative"), &TileData3DMesh::set_light_negative);
+	ClassDB::bind_method(D_METHOD("is_light_negative", "index"), &TileData3DMesh::is_light_negative);
+	ClassDB::bind_method(D_METHOD("set_light_specular", "index", "specular"), &TileData3DMesh::set_light_specular);
+	ClassDB::bind_method(D_METHOD("get_light_specular", "index"), &TileData3DMesh::get_light_specular);
+	ClassDB::bind_method(D_METHOD("set_light_shadow_enabled", "index", "enabled"), &TileData3DMesh::set_light_shadow_enabled);
+	ClassDB::bind_method(D_METHOD("is_light_shadow_enabled", "index"), &TileData3DMesh::is_light_shadow_enabled);
+	ClassDB::bind_method(D_METHOD("set_light_shadow_color", "index", "color"), &TileData3DMesh::set_light_shadow_color);
+	ClassDB::bind_method(D_METHOD("get_light_shadow_color", "index"), &TileData3DMesh::get_light_shadow_color);
+	ClassDB::bind_method(D_METHOD("set_light_shadow_bias", "index", "bias"), &TileData3DMesh::set_light_shadow_bias);
+	ClassDB::bind_method(D_METHOD("get_light_shadow_bias", "index"), &TileData3DMesh::get_light_shadow_bias);
+	ClassDB::bind_method(D_METHOD("set_light_shadow_normal_bias", "index", "bias"), &TileData3DMesh::set_light_shadow_normal_bias);
+	ClassDB::bind_method(D_METHOD("get_light_shadow_normal_bias", "index"), &TileData3DMesh::get_light_shadow_normal_bias);
+	ClassDB::bind_method(D_METHOD("set_light_shadow_reverse_cull_face", "index", "reverse"), &TileData3DMesh::set_light_shadow_reverse_cull_face);
+	ClassDB::bind_method(D_METHOD("is_light_shadow_reverse_cull_face", "index"), &TileData3DMesh::is_light_shadow_reverse_cull_face);
+	ClassDB::bind_method(D_METHOD("set_light_shadow_transmittance_bias", "index", "bias"), &TileData3DMesh::set_light_shadow_transmittance_bias);
+	ClassDB::bind_method(D_METHOD("get_light_shadow_transmittance_bias", "index"), &TileData3DMesh::get_light_shadow_transmittance_bias);
+	ClassDB::bind_method(D_METHOD("set_light_shadow_fog_fade", "index", "fade"), &TileData3DMesh::set_light_shadow_fog_fade);
+	ClassDB::bind_method(D_METHOD("get_light_shadow_fog_fade", "index"), &TileData3DMesh::get_light_shadow_fog_fade);
+	ClassDB::bind_method(D_METHOD("set_light_shadow_blur", "index", "blur"), &TileData3DMesh::set_light_shadow_blur);
+	ClassDB::bind_method(D_METHOD("get_light_shadow_blur", "index"), &TileData3DMesh::get_light_shadow_blur);
+
 	ADD_GROUP("Rendering", "");
 	ADD_PROPERTY(PropertyInfo(Variant::OBJECT, "mesh", PROPERTY_HINT_RESOURCE_TYPE, "Mesh"), "set_mesh", "get_mesh");
 	ADD_PROPERTY(PropertyInfo(Variant::TRANSFORM3D, "mesh_transform"), "set_mesh_transform", "get_mesh_transform");
+	// Low detail mesh, placed like the mesh, that casts the shadows instead of it.
+	ADD_PROPERTY(PropertyInfo(Variant::OBJECT, "shadow_mesh", PROPERTY_HINT_RESOURCE_TYPE, "Mesh"), "set_shadow_mesh", "get_shadow_mesh");
 	ADD_PROPERTY(PropertyInfo(Variant::OBJECT, "material_override", PROPERTY_HINT_RESOURCE_TYPE, "BaseMaterial3D,ShaderMaterial", PROPERTY_USAGE_DEFAULT | PROPERTY_USAGE_DEFERRED_SET_RESOURCE), "set_material_override", "get_material_override");
 	ADD_PROPERTY(PropertyInfo(Variant::FLOAT, "transparency", PROPERTY_HINT_RANGE, "0,1,0.01"), "set_transparency", "get_transparency");
 	ADD_PROPERTY(PropertyInfo(Variant::INT, "cast_shadow", PROPERTY_HINT_ENUM, "Off,On,Double-Sided,Shadows Only"), "set_cast_shadow_mode", "get_cast_shadow_mode");
@@ -916,6 +1054,11 @@ void TileData3DMesh::_bind_methods() {
 	ADD_PROPERTY(PropertyInfo(Variant::FLOAT, "visibility_range_end_margin", PROPERTY_HINT_RANGE, "0,1,0.01,or_greater"), "set_visibility_range_end_margin", "get_visibility_range_end_margin");
 	ADD_PROPERTY(PropertyInfo(Variant::INT, "visibility_range_fade_mode", PROPERTY_HINT_ENUM, "Disabled,Self,Dependencies"), "set_visibility_range_fade_mode", "get_visibility_range_fade_mode");
 
+	// Triangles in mesh space, merged into the occluder of each octant.
+	ADD_GROUP("Occlusion", "occlusion_");
+	ADD_PROPERTY(PropertyInfo(Variant::PACKED_VECTOR3_ARRAY, "occlusion_vertices"), "set_occlusion_vertices", "get_occlusion_vertices");
+	ADD_PROPERTY(PropertyInfo(Variant::PACKED_INT32_ARRAY, "occlusion_indices"), "set_occlusion_indices", "get_occlusion_indices");
+
 	ADD_GROUP("Miscellaneous", "");
 	ADD_ARRAY_COUNT("Physics", "physics_data_count", "set_physics_data_count", "get_physics_data_count", "physics_data_");
 	ADD_ARRAY_COUNT("Navigation", "navigation_data_count", "set_navigation_data_count", "get_navigation_data_count", "navigation_data_");
@@ -46,6 +46,9 @@ private:
     Vector3i span = Vector3i(1, 1, 1);
     Ref<Texture2D> preview;
     String source;
+    bool opaque_full_cell = false;
+    bool walkable = false;
+    float walk_cost = 1.0;
 
     // Alternative
     int alternative_id = -1;
@@ -77,6 +80,12 @@ public:
     float get_probability() const;
     void set_source(const String &p_source);
     String get_source() const;
+    void set_opaque_full_cell(bool p_opaque);
+    bool is_opaque_full_cell() const;
+    void set_walkable(bool p_walkable);
+    bool is_walkable() const;
+    void set_walk_cost(float p_cost);
+    float get_walk_cost() const;
 
     TileData3D(){}
     ~TileData3D(){}
@@ -135,6 +144,7 @@ public:
 private:
     Ref<Mesh> mesh;
     Transform3D mesh_transform = Transform3D();
+    Ref<Mesh> shadow_mesh;
     Ref<Material> material_override;
     float transparency = 0.0;
     GeometryInstance3D::ShadowCastingSetting cast_shadow = GeometryInstance3D::SHADOW_CASTING_SETTING_ON;
@@ -171,6 +181,8 @@ public:
     Ref<Mesh> get_mesh() const;
     void set_mesh_transform(const Transform3D &p_transform);
     Transform3D get_mesh_transform() const;
+    void set_shadow_mesh(const Ref<Mesh> &p_mesh);
+    Ref<Mesh> get_shadow_mesh() const;
     void set_material_override(const Ref<Material> &p_material);
     Ref<Material> get_material_override() const;
     void set_transparency(float p_transparency);
@@ -198,6 +210,11 @@ public:
     void set_visibility_range_fade_mode(GeometryInstance3D::VisibilityRangeFadeMode p_mode);
     GeometryInstance3D::VisibilityRangeFadeMode get_visibility_range_fade_mode() const;
 
+    void set_occlusion_vertices(const PackedVector3Array &p_vertices);
+    PackedVector3Array get_occlusion_vertices() const;
+    void set_occlusion_indices(const PackedInt32Array &p_indices);
+    PackedInt32Array get_occlusion_indices() const;
+
     void set_physics_data_count(int p_count);
     int get_physics_data_count() const;
 	void add_physics_data(int p_index = -1);
@@ -229,6 +246,9 @@ public:
     void set_navigation_data_navmesh_transform(int p_index, const Transform3D &p_transform);
     Transform3D get_navigation_data_navmesh_transform(int p_index) const;
 
+    void set_light_count(int p_count);
+    int get_light_count() const;
+    const LightTileData3D &get_light(int p_index) const;
     void set_light_transform(int p_index, const Transform3D &p_transform);
     Transform3D get_light_transform(int p_index) const;
     void set_light_type(int p_index, LightType p_type);